@@ -0,0 +1,84 @@
+#include <SoftwareSerial.h>
+#include <GT5X.h>
+
+/* Search the fingerprint database for a print, without blocking loop() 
+ * while the sensor is busy */
+
+/*  pin #2 is IN from sensor
+ *  pin #3 is OUT from arduino (3.3V I/O!)
+ */
+SoftwareSerial fserial(2, 3);
+
+GT5X finger(&fserial);
+GT5X_DeviceInfo ginfo;
+
+/* what we're waiting on */
+enum {
+    STEP_PRESS,
+    STEP_CAPTURE,
+    STEP_SEARCH
+};
+
+uint8_t step = STEP_PRESS;
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("ASYNC 1:N MATCH test");
+    fserial.begin(9600);
+
+    if (finger.begin(&ginfo)) {
+        Serial.println("Found fingerprint sensor!");
+        Serial.print("Firmware Version: "); Serial.println(ginfo.fwversion, HEX);
+    } else {
+        Serial.println("Did not find fingerprint sensor :(");
+        while (1) yield();
+    }
+    
+    Serial.println("Place a finger to search.");
+
+    /* turn on led for print capture */
+    finger.set_led(true);
+    finger.start_command(GT5X_ISPRESSFINGER, 0, on_done);
+}
+
+/* runs from inside poll() whenever a command completes */
+void on_done(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    switch (step) {
+        case STEP_PRESS:
+            /* 0 means a finger is on the sensor */
+            if (rc == GT5X_OK && param == 0) {
+                step = STEP_CAPTURE;
+                sensor->start_command(GT5X_CAPTUREFINGER, 0, on_done);
+                return;
+            }
+            break;
+        case STEP_CAPTURE:
+            if (rc == GT5X_OK) {
+                step = STEP_SEARCH;
+                sensor->start_command(GT5X_IDENTIFY1_N, 0, on_done);
+                return;
+            }
+            break;
+        case STEP_SEARCH:
+            if (rc == GT5X_OK) {
+                Serial.print("Print at ID "); Serial.println(param);
+            }
+            else {
+                Serial.println("Print not found!");
+            }
+            break;
+    }
+    
+    /* start over */
+    step = STEP_PRESS;
+    sensor->start_command(GT5X_ISPRESSFINGER, 0, on_done);
+}
+
+void loop()
+{
+    /* advances the sensor's state machine with whatever bytes have arrived */
+    finger.poll();
+    
+    /* ...free to service other things here */
+}
@@ -0,0 +1,110 @@
+#include <SoftwareSerial.h>
+#include <SD.h>
+#include <GT5X.h>
+#include <GT5XBackup.h>
+
+/* Back up the whole template database to an SD card, or restore it */
+
+/*  pin #2 is IN from sensor
+ *  pin #3 is OUT from arduino (3.3V I/O!)
+ *  SD card chip select on pin #4
+ */
+SoftwareSerial fserial(2, 3);
+
+GT5X finger(&fserial);
+GT5X_Backup backup(&finger);
+GT5X_DeviceInfo ginfo;
+
+#define BACKUP_FILE     "GT5X.BAK"
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("BACKUP test");
+    fserial.begin(9600);
+
+    if (finger.begin(&ginfo)) {
+        Serial.println("Found fingerprint sensor!");
+        Serial.print("Firmware Version: "); Serial.println(ginfo.fwversion, HEX);
+    } else {
+        Serial.println("Did not find fingerprint sensor :(");
+        while (1) yield();
+    }
+    
+    if (!SD.begin(4)) {
+        Serial.println("SD card failed!");
+        while (1) yield();
+    }
+}
+
+void loop()
+{
+    while (Serial.read() != -1);  // clear buffer
+    
+    Serial.println("Send 'b' to back up the database, 'r' to restore it...");
+    while (! Serial.available()) yield();
+    char c = Serial.read();
+    
+    if (c == 'b')
+        export_db();
+    else if (c == 'r')
+        import_db();
+    
+    Serial.println();
+}
+
+void export_db(void) {
+    SD.remove(BACKUP_FILE);
+    File f = SD.open(BACKUP_FILE, FILE_WRITE);
+    if (!f) {
+        Serial.println("Could not create file!");
+        return;
+    }
+    
+    /* templates go straight from the sensor to the file */
+    GT5X_StreamSink sink(&f);
+    backup.reset();
+    uint16_t rc = backup.export_db(&sink);
+    f.close();
+    
+    if (rc != GT5X_OK) {
+        Serial.print("Export failed: 0x"); Serial.println(rc, HEX);
+        return;
+    }
+    
+    Serial.print("Exported "); Serial.print(backup.progress.done); Serial.println(" templates.");
+}
+
+uint8_t template_buf[GT5X_TEMPLATESZ];
+
+void import_db(void) {
+    File f = SD.open(BACKUP_FILE);
+    if (!f) {
+        Serial.println("No backup found!");
+        return;
+    }
+    
+    /* if an earlier restore was cut short, this resumes from where it stopped */
+    GT5X_StreamSource source(&f);
+    uint16_t rc = backup.import_db(&source, template_buf);
+    f.close();
+    
+    switch (rc) {
+        case GT5X_OK:
+            break;
+        case GT5X_BAD_FORMAT:
+            Serial.println("Not a GT5X backup!");
+            return;
+        case GT5X_BAD_CHECKSUM:
+            Serial.println("Backup is corrupted!");
+            return;
+        default:
+            Serial.print("Import stopped: 0x"); Serial.println(rc, HEX);
+            Serial.println("Restore again to resume.");
+            return;
+    }
+    
+    Serial.print("Imported "); Serial.print(backup.progress.done); Serial.print(" templates, ");
+    Serial.print(backup.progress.failed); Serial.println(" refused.");
+    backup.reset();
+}
@@ -0,0 +1,108 @@
+#include <SoftwareSerial.h>
+#include <GT5X.h>
+#include <GT5XEnroll.h>
+
+/* Enroll a run of IDs back-to-back, sending each new template to the PC as hex */
+
+/*  pin #2 is IN from sensor
+ *  pin #3 is OUT from arduino (3.3V I/O!)
+ */
+SoftwareSerial fserial(2, 3);
+
+GT5X finger(&fserial);
+GT5X_Enroller enroller(&finger);
+GT5X_DeviceInfo ginfo;
+
+#define BATCH_SIZE      10
+uint16_t ids[BATCH_SIZE];
+
+/* stands in for an upload to your server */
+class HexSink : public GT5X_Sink {
+    public:
+        bool write(const uint8_t * data, uint16_t len) {
+            for (uint16_t i = 0; i < len; i++) {
+                if (data[i] < 0x10) Serial.print('0');
+                Serial.print(data[i], HEX);
+            }
+            return true;
+        }
+};
+
+HexSink hex_sink;
+uint8_t last_prompt = GT5X_PROMPT_NONE;
+
+void set_port(uint32_t baud, void * ctx) {
+    fserial.begin(baud);
+}
+
+void on_enrolled(GT5X * sensor, uint16_t rc, uint32_t fid, void * ctx) {
+    Serial.println();
+    Serial.print("ID "); Serial.print(fid);
+    
+    if (rc == GT5X_OK)
+        Serial.println(" enrolled.");
+    else if (rc < GT5X_OK) {
+        Serial.print(" skipped, finger already enrolled as ID "); Serial.println(rc);
+    }
+    else {
+        Serial.print(" failed, error code: 0x"); Serial.println(rc, HEX);
+    }
+}
+
+void setup()
+{
+    Serial.begin(57600);
+    Serial.println("BATCH ENROLL test");
+    fserial.begin(9600);
+
+    if (finger.begin(&ginfo, set_port, NULL, 57600)) {
+        Serial.println("Found fingerprint sensor!");
+        Serial.print("Firmware Version: "); Serial.println(ginfo.fwversion, HEX);
+    } else {
+        Serial.println("Did not find fingerprint sensor :(");
+        while (1) yield();
+    }
+    
+    enroller.set_sink(&hex_sink);
+}
+
+void loop()
+{
+    while (Serial.read() != -1);  // clear buffer
+    
+    Serial.println("Enter the first ID of the batch...");
+    uint16_t first = 0;
+    while (true) {
+        while (! Serial.available()) yield();
+        char c = Serial.read();
+        if (! isdigit(c)) break;
+        first *= 10;
+        first += c - '0';
+        yield();
+    }
+    
+    for (uint16_t i = 0; i < BATCH_SIZE; i++)
+        ids[i] = first + i;
+    
+    enroller.start_batch(ids, BATCH_SIZE, on_enrolled);
+    
+    while (enroller.poll()) {
+        uint8_t prompt = enroller.prompt();
+        if (prompt != last_prompt) {
+            if (prompt == GT5X_PROMPT_PLACE) {
+                Serial.print("ID "); Serial.print(enroller.current_fid());
+                Serial.print(", scan "); Serial.print(enroller.current_pass());
+                Serial.println(": place your finger.");
+            }
+            else if (prompt == GT5X_PROMPT_LIFT) {
+                Serial.println("Remove finger.");
+            }
+            last_prompt = prompt;
+        }
+        yield();
+    }
+    
+    Serial.print(enroller.progress.enrolled); Serial.print(" enrolled, ");
+    Serial.print(enroller.progress.duplicates); Serial.print(" duplicates, ");
+    Serial.print(enroller.progress.failed); Serial.println(" failed.");
+}
@@ -0,0 +1,102 @@
+#include <SoftwareSerial.h>
+#include <SD.h>
+#include <GT5X.h>
+#include <GT5XUpgrade.h>
+
+/* Upload a firmware image from an SD card to the sensor */
+
+/*  pin #2 is IN from sensor
+ *  pin #3 is OUT from arduino (3.3V I/O!)
+ *  SD card chip select on pin #4
+ */
+SoftwareSerial fserial(2, 3);
+
+GT5X finger(&fserial);
+GT5X_DeviceInfo ginfo;
+
+/* two chunks, so the next one is read from the card while the sensor writes the last */
+uint8_t work[2 * GT5X_UPGRADE_CHUNKSZ];
+GT5X_Upgrader upgrader(&finger, work, sizeof(work));
+
+#define FIRMWARE_FILE   "GT5X.BIN"
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("FIRMWARE UPGRADE test");
+    fserial.begin(9600);
+
+    if (finger.begin(&ginfo)) {
+        Serial.println("Found fingerprint sensor!");
+        Serial.print("Firmware Version: "); Serial.println(ginfo.fwversion, HEX);
+    } else {
+        Serial.println("Did not find fingerprint sensor :(");
+        while (1) yield();
+    }
+    
+    if (!SD.begin(4)) {
+        Serial.println("SD card failed!");
+        while (1) yield();
+    }
+}
+
+void loop()
+{
+    while (Serial.read() != -1);  // clear buffer
+    
+    Serial.println("Send 'u' to upload " FIRMWARE_FILE "...");
+    while (Serial.read() != 'u') yield();
+    
+    File f = SD.open(FIRMWARE_FILE);
+    if (!f) {
+        Serial.println("No firmware image found!");
+        return;
+    }
+    
+    GT5X_StreamSource source(&f);
+    if (!upgrader.start(GT5X_UPGRADEFIRMWARE, &source, f.size())) {
+        Serial.println("Could not start the upload!");
+        f.close();
+        return;
+    }
+    
+    uint16_t rc = report();
+    
+    /* a chunk that kept failing is still held, so it can be sent again */
+    while (rc != GT5X_OK && upgrader.can_resume()) {
+        Serial.print("Upload stalled: 0x"); Serial.println(rc, HEX);
+        Serial.println("Send 'r' to resume...");
+        while (Serial.read() != 'r') yield();
+        
+        upgrader.resume();
+        rc = report();
+    }
+    
+    f.close();
+    
+    if (rc != GT5X_OK) {
+        Serial.print("Upload failed: 0x"); Serial.println(rc, HEX);
+        return;
+    }
+    
+    Serial.print("Uploaded "); Serial.print(upgrader.progress.sent); Serial.print(" bytes in ");
+    Serial.print(upgrader.progress.elapsed_ms); Serial.print(" ms, ");
+    Serial.print(upgrader.progress.retries); Serial.println(" chunks resent.");
+}
+
+/* prints progress every 10 chunks until the upload stops */
+uint16_t report(void) {
+    uint16_t last = 0;
+    
+    while (upgrader.poll()) {
+        if (upgrader.progress.chunks >= last + 10) {
+            last = upgrader.progress.chunks;
+            Serial.print(upgrader.progress.sent); Serial.print(" / "); Serial.print(upgrader.progress.total);
+            Serial.print(" bytes, "); Serial.print(upgrader.bytes_per_sec()); Serial.print(" B/s, ");
+            Serial.print(upgrader.eta_ms() / 1000); Serial.println(" s left");
+        }
+        yield();
+    }
+    
+    return upgrader.wait();
+}
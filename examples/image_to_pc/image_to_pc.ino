@@ -1,5 +1,6 @@
 #include <SoftwareSerial.h>
 #include <GT5X.h>
+#include <GT5XCompress.h>
 
 /* Send fingerprint images to pc */
 
@@ -11,15 +12,28 @@ SoftwareSerial fserial(2, 3);
 GT5X finger(&fserial);
 GT5X_DeviceInfo ginfo;
 
+/* compress the image for the PC link; getImage.py/getImage.cpp pick this up on their own */
+#define COMPRESS_IMAGE  1
+
+/* lets begin() move the link to a faster rate */
+void set_port(uint32_t baud, void * ctx) {
+    (void)ctx;
+    fserial.begin(baud);
+}
+
 void setup()
 {
-    Serial.begin(9600);
+    /* the PC link has to outrun the sensor link, or SoftwareSerial's
+       64-byte buffer overflows while the image goes out */
+    Serial.begin(115200);
     Serial.println("GET IMAGE test");
     fserial.begin(9600);
 
-    if (finger.begin(&ginfo)) {
+    /* SoftwareSerial is only reliable up to 57600 */
+    if (finger.begin(&ginfo, set_port, NULL, 57600)) {
         Serial.println("Found fingerprint sensor!");
         Serial.print("Firmware Version: "); Serial.println(ginfo.fwversion, HEX);
+        Serial.print("Link at "); Serial.println(finger.get_baud_rate());
     } else {
         Serial.println("Did not find fingerprint sensor :(");
         while (1) yield();
@@ -58,14 +72,28 @@ void stream_image(void) {
     if (rc != GT5X_OK)
         return;
     
-    /* header to indicate start of image stream to PC */
     Serial.println("Remove finger. \r\nSending image...");
-    Serial.write('\t');
     
-    bool ret = finger.read_raw(GT5X_OUTPUT_TO_STREAM, &Serial, GT5X_IMAGESZ);
+    /* the last pixel is only sent once the whole image checks out, 
+       so the PC never sees a full-length corrupted image */
+#if COMPRESS_IMAGE
+    /* header to indicate start of compressed image stream to PC */
+    Serial.write(GT5X_RLE_STREAM_START);
+    
+    GT5X_StreamSink serial_sink(&Serial);
+    GT5X_RLESink rle(&serial_sink, GT5X_IMAGESZ);
+    bool ret = finger.read_raw(&rle, GT5X_IMAGESZ, true);
+#else
+    /* header to indicate start of image stream to PC */
+    Serial.write('\t');
+    bool ret = finger.read_raw(GT5X_OUTPUT_TO_STREAM_VERIFIED, &Serial, GT5X_IMAGESZ);
+#endif
     
     if (!ret) {
-        Serial.println("\r\nImage read failed!");
+        if (finger.get_raw_error() == GT5X_BAD_CHECKSUM)
+            Serial.println("\r\nImage corrupted!");
+        else
+            Serial.println("\r\nImage read failed!");
         return;
     }
 
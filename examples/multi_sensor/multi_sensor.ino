@@ -0,0 +1,87 @@
+#include <GT5X.h>
+#include <GT5XManager.h>
+
+/* Search for prints on two sensors at once, e.g. entry and exit 
+ * readers on an Arduino Mega. Neither sensor waits on the other. */
+
+/*  Serial1 (pins 19/18) and Serial2 (pins 17/16) 
+ *  go to the two sensors (3.3V I/O!)
+ */
+GT5X entry(&Serial1);
+GT5X exit_reader(&Serial2);
+
+GT5X_Manager manager;
+
+const char * names[] = {"Entry", "Exit"};
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("MULTI SENSOR test");
+    
+    Serial1.begin(9600);
+    Serial2.begin(9600);
+
+    if (!entry.begin() || !exit_reader.begin()) {
+        Serial.println("Did not find both fingerprint sensors :(");
+        while (1) yield();
+    }
+    
+    manager.add(&entry);
+    manager.add(&exit_reader);
+    
+    for (uint8_t i = 0; i < manager.count(); i++) {
+        manager.sensor(i)->set_led(true);
+        start_search(i);
+    }
+}
+
+/* capture, then identify; the manager runs them back to back */
+void start_search(uint8_t idx) {
+    manager.submit(idx, GT5X_CAPTUREFINGER, 0, on_capture, (void *)(uintptr_t)idx);
+}
+
+void on_capture(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    uint8_t idx = (uintptr_t)ctx;
+    
+    if (rc == GT5X_OK)
+        manager.submit(idx, GT5X_IDENTIFY1_N, 0, on_search, ctx);
+    else
+        start_search(idx);
+}
+
+void on_search(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    uint8_t idx = (uintptr_t)ctx;
+    
+    Serial.print(names[idx]); 
+    if (rc == GT5X_OK) {
+        Serial.print(": print at ID "); Serial.println(param);
+    }
+    else {
+        Serial.println(": print not found!");
+    }
+    
+    start_search(idx);
+}
+
+void loop()
+{
+    manager.poll();
+    
+    /* print queue stats every 10s */
+    static uint32_t last_report = 0;
+    if (millis() - last_report < 10000)
+        return;
+    
+    last_report = millis();
+    for (uint8_t i = 0; i < manager.count(); i++) {
+        GT5X_SensorStats stats;
+        manager.get_stats(i, &stats);
+        
+        Serial.print(names[i]); Serial.print(": ");
+        Serial.print(stats.completed); Serial.print(" commands, avg latency ");
+        Serial.print(stats.completed ? stats.total_latency / stats.completed : 0); 
+        Serial.print(" ms, queue depth "); Serial.print(stats.queued);
+        Serial.print(", link busy "); Serial.print(manager.utilisation(i)); Serial.println("%");
+    }
+}
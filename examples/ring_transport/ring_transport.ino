@@ -0,0 +1,113 @@
+#include <GT5X.h>
+#include <GT5XRing.h>
+
+/* Read an image at 115200 baud through an interrupt-fed ring buffer.
+ * 
+ * For the Mega's USART1: Serial1 is left alone so that this sketch can 
+ * own the RX interrupt. Pin #19 is IN from sensor, pin #18 is OUT from 
+ * arduino (3.3V I/O!) */
+
+#if !defined(__AVR_ATmega2560__) && !defined(__AVR_ATmega1280__)
+#error "This example drives USART1 of an ATmega1280/2560 directly"
+#endif
+
+/* TX is plain polled writes, only RX needs the ring */
+class Usart1Tx : public Print {
+    public:
+        size_t write(uint8_t c) {
+            while (!(UCSR1A & _BV(UDRE1)));
+            UDR1 = c;
+            return 1;
+        }
+};
+
+/* there's no room for the whole image on the Mega, so just count it through */
+class CountingSink : public GT5X_Sink {
+    public:
+        CountingSink() : total(0) {}
+        bool write(const uint8_t * data, uint16_t len) {
+            total += len;
+            return true;
+        }
+        
+        uint32_t total;
+};
+
+Usart1Tx usart1_tx;
+uint8_t rx_storage[GT5X_RING_SIZE];
+GT5X_RingTransport ring(rx_storage, sizeof(rx_storage), &usart1_tx);
+
+GT5X finger(&ring);
+GT5X_DeviceInfo ginfo;
+
+/* the only producer: one byte per interrupt, never blocks */
+ISR(USART1_RX_vect) {
+    ring.push(UDR1);
+}
+
+/* lets begin() move the link to a faster rate */
+void set_port(uint32_t baud, void * ctx) {
+    /* double speed keeps 115200 within 2.1% at 16MHz */
+    UCSR1A = _BV(U2X1);
+    UBRR1 = (F_CPU / 4 / baud - 1) / 2;
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UCSR1B = _BV(RXEN1) | _BV(TXEN1) | _BV(RXCIE1);
+    ring.discard();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("RING TRANSPORT test");
+    set_port(9600, NULL);
+
+    if (finger.begin(&ginfo, set_port, NULL, 115200)) {
+        Serial.println("Found fingerprint sensor!");
+        Serial.print("Link at "); Serial.println(finger.get_baud_rate());
+    } else {
+        Serial.println("Did not find fingerprint sensor :(");
+        while (1) yield();
+    }
+}
+
+void loop() {
+    read_image();
+    
+    GT5X_RingStats stats;
+    ring.get_stats(&stats);
+    Serial.print("Received: "); Serial.println(stats.received);
+    Serial.print("Overruns: "); Serial.println(stats.overruns);
+    Serial.print("Most buffered: "); Serial.println(stats.high_water);
+    ring.reset_stats();
+    
+    delay(2000);
+}
+
+void read_image(void) {
+    Serial.println("Place your finger.");
+    finger.set_led(true);
+
+    uint16_t rc;
+    while ((rc = finger.capture_finger()) == GT5X_NACK_FINGER_IS_NOT_PRESSED)
+        delay(10);
+    
+    if (rc == GT5X_OK)
+        rc = finger.get_image();
+    
+    if (rc != GT5X_OK) {
+        Serial.print("Error code: 0x"); Serial.println(rc, HEX);
+        finger.set_led(false);
+        return;
+    }
+    
+    Serial.println("Remove finger.");
+    
+    CountingSink counter;
+    if (finger.read_raw(&counter, GT5X_IMAGESZ)) {
+        Serial.print(counter.total); Serial.println(" bytes read.");
+    } else {
+        Serial.print("Image read failed: 0x"); Serial.println(finger.get_raw_error(), HEX);
+    }
+
+    finger.set_led(false);
+}
@@ -26,27 +26,23 @@ void setup()
     }
     
     Serial.println("Place a finger to search.");
-
-    /* turn on led for print capture */
-    finger.set_led(true);
 }
 
 
 void loop()
 {
-    if (!finger.is_pressed())
-        return;
-
-    uint16_t rc = finger.capture_finger();  
-    if (rc != GT5X_OK)
-        return;
-    
+    /* waits for a finger, captures and searches, with the LED handled for us */
     uint16_t fid;
-    rc = finger.search_database(&fid);
+    uint16_t rc = finger.identify_finger(&fid);
     if (rc != GT5X_OK) {
         Serial.println("Print not found!");
         return;
     }
     
     Serial.print("Print at ID "); Serial.println(fid);
+    
+    GT5X_IdentifyTiming timing;
+    finger.get_identify_timing(&timing);
+    Serial.print("Capture: "); Serial.print(timing.capture); 
+    Serial.print(" ms, search: "); Serial.print(timing.identify); Serial.println(" ms");
 }
@@ -0,0 +1,88 @@
+#include <SD.h>
+#include <GT5X.h>
+#include <GT5XManager.h>
+#include <GT5XShards.h>
+
+/* One gallery spread over three sensors on an Arduino Mega, searched all 
+ * at once. The first sensor doubles as the reader people put their finger on. */
+
+/*  Serial1 (pins 19/18), Serial2 (pins 17/16) and Serial3 (pins 15/14)
+ *  go to the three sensors (3.3V I/O!)
+ *  SD card chip select on pin #4, holding the ID map
+ */
+GT5X reader(&Serial1);
+GT5X shard2(&Serial2);
+GT5X shard3(&Serial3);
+
+GT5X_Manager manager;
+
+/* global ID -> (sensor, slot); 1000 IDs fit in the Mega's RAM */
+#define MAX_IDS         1000
+GT5X_ShardEntry id_map[MAX_IDS];
+GT5X_Shards shards(&manager, id_map, MAX_IDS, 200);
+
+#define MAP_FILE        "SHARDS.MAP"
+
+uint8_t probe[GT5X_TEMPLATESZ];
+
+void setup()
+{
+    Serial.begin(9600);
+    Serial.println("SHARDED SEARCH test");
+    
+    Serial1.begin(9600);
+    Serial2.begin(9600);
+    Serial3.begin(9600);
+
+    if (!reader.begin() || !shard2.begin() || !shard3.begin()) {
+        Serial.println("Did not find all fingerprint sensors :(");
+        while (1) yield();
+    }
+    
+    manager.add(&reader);
+    manager.add(&shard2);
+    manager.add(&shard3);
+    
+    /* the map is saved alongside the templates whenever they change */
+    if (!SD.begin(4)) {
+        Serial.println("SD card failed!");
+        while (1) yield();
+    }
+    
+    File f = SD.open(MAP_FILE);
+    GT5X_StreamSource source(&f);
+    if (!f || shards.load(&source) != GT5X_OK) {
+        Serial.println("No ID map found!");
+        while (1) yield();
+    }
+    f.close();
+    
+    reader.set_led(true);
+}
+
+void loop()
+{
+    Serial.println("Place your finger.");
+    while (reader.capture_finger() != GT5X_OK) yield();
+    
+    /* the reader turns the print into a template, then every shard searches for it */
+    if (reader.make_template() != GT5X_OK || 
+        !reader.read_raw(GT5X_OUTPUT_TO_BUFFER, probe, GT5X_TEMPLATESZ)) {
+        Serial.println("Could not get a template!");
+        return;
+    }
+    
+    uint16_t gid;
+    uint16_t rc = shards.identify(probe, &gid);
+    if (rc == GT5X_OK) {
+        Serial.print("Found print with ID #"); Serial.println(gid);
+    }
+    else if (rc == GT5X_NACK_IDENTIFY_FAILED) {
+        Serial.println("Did not find a match.");
+    }
+    else {
+        Serial.print("Search failed: 0x"); Serial.println(rc, HEX);
+    }
+    
+    while (reader.is_pressed()) yield();
+}
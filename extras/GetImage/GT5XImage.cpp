@@ -0,0 +1,301 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+#include "GT5XImage.h"
+
+#define BLOCK_COLS      (GT5X_IMAGE_WIDTH / GT5X_RIDGE_BLOCK)
+
+/* a fingerprint block varies by a lot more than sensor noise does */
+#define DEFAULT_RIDGE_STDDEV    12.0
+
+/* dst gets every pixel of src twice over; n is a multiple of 16 (the row width) */
+static void double_row(const uint8_t * src, uint8_t * dst, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(v, v));
+        _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(v, v));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x16x2_t z = vzipq_u8(v, v);
+        vst1q_u8(dst + 2 * i, z.val[0]);
+        vst1q_u8(dst + 2 * i + 16, z.val[1]);
+    }
+#else
+    for (; i < n; i++) {
+        dst[2 * i] = src[i];
+        dst[2 * i + 1] = src[i];
+    }
+#endif
+}
+
+/* sum of (a[i] - b[i])^2 */
+static uint64_t sq_diff_sum(const uint8_t * a, const uint8_t * b, int n) {
+    uint64_t total = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    total = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; i++) {
+        int d = (int)a[i] - b[i];
+        total += d * d;
+    }
+    return total;
+}
+
+GT5XImage::GT5XImage() : ridge_var(DEFAULT_RIDGE_STDDEV * DEFAULT_RIDGE_STDDEV)
+{
+    reset();
+}
+
+void GT5XImage::reset(void) {
+    received = 0;
+    rows_done = 0;
+    sum = sumsq = grad = 0;
+    grad_n = 0;
+    ridge_blocks = total_blocks = 0;
+
+    memset(hist, 0, sizeof(hist));
+    memset(block_sum, 0, sizeof(block_sum));
+    memset(block_sumsq, 0, sizeof(block_sumsq));
+}
+
+size_t GT5XImage::feed(const uint8_t * data, size_t len) {
+    size_t taken = 0;
+
+    while (taken < len && !complete()) {
+        size_t col = received % GT5X_IMAGE_WIDTH;
+        size_t n = GT5X_IMAGE_WIDTH - col;
+        if (n > len - taken)
+            n = len - taken;
+
+        memcpy(row + col, data + taken, n);
+        taken += n;
+        received += n;
+
+        if (received % GT5X_IMAGE_WIDTH == 0)
+            finish_row();
+    }
+
+    return taken;
+}
+
+void GT5XImage::finish_row(void) {
+    uint8_t * dst = out + (size_t)rows_done * GT5X_IMAGE_SCALE * GT5X_OUT_WIDTH;
+    double_row(row, dst, GT5X_IMAGE_WIDTH);
+    memcpy(dst + GT5X_OUT_WIDTH, dst, GT5X_OUT_WIDTH);
+
+    /* horizontal gradient within the row, vertical against the one before */
+    grad += sq_diff_sum(row, row + 1, GT5X_IMAGE_WIDTH - 1);
+    grad_n += GT5X_IMAGE_WIDTH - 1;
+    if (rows_done > 0) {
+        grad += sq_diff_sum(row, prev, GT5X_IMAGE_WIDTH);
+        grad_n += GT5X_IMAGE_WIDTH;
+    }
+
+    for (int x = 0; x < GT5X_IMAGE_WIDTH; x++) {
+        uint32_t p = row[x];
+        sum += p;
+        sumsq += p * p;
+        hist[p]++;
+        block_sum[x / GT5X_RIDGE_BLOCK] += p;
+        block_sumsq[x / GT5X_RIDGE_BLOCK] += p * p;
+    }
+
+    memcpy(prev, row, GT5X_IMAGE_WIDTH);
+    rows_done++;
+
+    if (rows_done % GT5X_RIDGE_BLOCK == 0)
+        finish_strip();
+}
+
+void GT5XImage::finish_strip(void) {
+    const double n = GT5X_RIDGE_BLOCK * GT5X_RIDGE_BLOCK;
+
+    for (int b = 0; b < BLOCK_COLS; b++) {
+        double mean = block_sum[b] / n;
+        double var = block_sumsq[b] / n - mean * mean;
+        if (var >= ridge_var)
+            ridge_blocks++;
+    }
+
+    total_blocks += BLOCK_COLS;
+    memset(block_sum, 0, sizeof(block_sum));
+    memset(block_sumsq, 0, sizeof(block_sumsq));
+}
+
+void GT5XImage::metrics(GT5XImageMetrics * m) const {
+    double n = received ? (double)received : 1;
+    m->mean = sum / n;
+    double var = sumsq / n - m->mean * m->mean;
+    m->contrast = var > 0 ? sqrt(var) : 0;
+    m->sharpness = grad_n ? (double)grad / grad_n : 0;
+    m->ridge_coverage = total_blocks ? (double)ridge_blocks / total_blocks : 0;
+
+    uint32_t seen = 0;
+    m->p5 = m->p95 = 0;
+    bool got5 = false;
+    for (int i = 0; i < 256; i++) {
+        seen += hist[i];
+        if (!got5 && seen >= received * 5 / 100) {
+            m->p5 = i;
+            got5 = true;
+        }
+        if (seen >= received * 95 / 100) {
+            m->p95 = i;
+            break;
+        }
+    }
+}
+
+bool GT5XImage::passes(const GT5XImageGate & gate, GT5XImageMetrics * m) const {
+    GT5XImageMetrics local;
+    if (m == NULL)
+        m = &local;
+
+    metrics(m);
+    return complete()
+        && m->contrast >= gate.min_contrast
+        && m->sharpness >= gate.min_sharpness
+        && m->ridge_coverage >= gate.min_ridge_coverage;
+}
+
+static void put_le(uint8_t * p, uint32_t v, int n) {
+    for (int i = 0; i < n; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+/* 8-bit greyscale, top-down rows; 320 is a multiple of 4 so there's no row padding */
+bool GT5XImage::write_bmp(const char * path) const {
+    const uint32_t palette_sz = 256 * 4;
+    const uint32_t offset = 54 + palette_sz;
+    const uint32_t image_sz = GT5X_OUT_WIDTH * GT5X_OUT_HEIGHT;
+
+    std::vector<uint8_t> file(offset + image_sz, 0);
+    uint8_t * h = &file[0];
+
+    h[0] = 'B';
+    h[1] = 'M';
+    put_le(h + 2, offset + image_sz, 4);
+    put_le(h + 10, offset, 4);
+    put_le(h + 14, 40, 4);
+    put_le(h + 18, GT5X_OUT_WIDTH, 4);
+    put_le(h + 22, (uint32_t)-GT5X_OUT_HEIGHT, 4);
+    put_le(h + 26, 1, 2);
+    put_le(h + 28, 8, 2);
+    put_le(h + 34, image_sz, 4);
+    put_le(h + 38, 1, 4);
+    put_le(h + 42, 1, 4);
+
+    for (int i = 0; i < 256; i++)
+        memset(h + 54 + 4 * i, i, 4);
+
+    memcpy(h + offset, out, image_sz);
+
+    FILE * f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+
+    bool ok = fwrite(h, 1, file.size(), f) == file.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool GT5XImage::write_pgm(const char * path) const {
+    char header[32];
+    int hlen = snprintf(header, sizeof(header), "P5\n%d %d\n255\n", GT5X_OUT_WIDTH, GT5X_OUT_HEIGHT);
+
+    std::vector<uint8_t> file(hlen + sizeof(out));
+    memcpy(&file[0], header, hlen);
+    memcpy(&file[hlen], out, sizeof(out));
+
+    FILE * f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+
+    bool ok = fwrite(&file[0], 1, file.size(), f) == file.size();
+    return fclose(f) == 0 && ok;
+}
+
+/* keep in step with src/GT5XCompress.h */
+#define RLE_MIN_RUN     3
+
+GT5XRLEDecoder::GT5XRLEDecoder(GT5XImage * image) : img(image)
+{
+    reset();
+}
+
+void GT5XRLEDecoder::reset(void) {
+    consumed = 0;
+    prev = 0;
+    literals_left = 0;
+    have_ctrl = false;
+}
+
+void GT5XRLEDecoder::put(uint8_t delta, size_t count) {
+    uint8_t px[128 + RLE_MIN_RUN];
+    for (size_t i = 0; i < count; i++) {
+        prev += delta;
+        px[i] = prev;
+    }
+    img->feed(px, count);
+}
+
+size_t GT5XRLEDecoder::feed(const uint8_t * data, size_t len) {
+    size_t i = 0;
+
+    while (i < len && !img->complete()) {
+        if (!have_ctrl) {
+            ctrl = data[i++];
+            have_ctrl = true;
+            literals_left = (ctrl < 0x80) ? ctrl + 1 : 0;
+            continue;
+        }
+
+        if (ctrl >= 0x80) {
+            put(data[i++], ctrl - 0x80 + RLE_MIN_RUN);
+            have_ctrl = false;
+            continue;
+        }
+
+        /* literals: undo the deltas for as many as are here */
+        size_t n = len - i < literals_left ? len - i : literals_left;
+        uint8_t px[128];
+        for (size_t k = 0; k < n; k++) {
+            prev += data[i + k];
+            px[k] = prev;
+        }
+        img->feed(px, n);
+
+        i += n;
+        literals_left -= n;
+        if (literals_left == 0)
+            have_ctrl = false;
+    }
+
+    consumed += i;
+    return i;
+}
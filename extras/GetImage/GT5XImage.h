@@ -0,0 +1,112 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Host-side handling of the 160 x 120 image from get_image(). Pixels can be
+ * fed in whatever chunks they arrive in; each row is upscaled 2x and folded
+ * into the quality metrics as soon as it's complete, so by the time the last
+ * byte is in the image is ready to save and judge. */
+
+#ifndef GT5X_IMAGE_H
+#define GT5X_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define GT5X_IMAGE_WIDTH        160
+#define GT5X_IMAGE_HEIGHT       120
+#define GT5X_IMAGE_SCALE        2
+
+#define GT5X_OUT_WIDTH          (GT5X_IMAGE_WIDTH * GT5X_IMAGE_SCALE)
+#define GT5X_OUT_HEIGHT         (GT5X_IMAGE_HEIGHT * GT5X_IMAGE_SCALE)
+
+/* ridge coverage is judged over square blocks of this many source pixels */
+#define GT5X_RIDGE_BLOCK        8
+
+struct GT5XImageMetrics {
+    double mean;            /* average grey level */
+    double contrast;        /* standard deviation of the grey level */
+    uint8_t p5, p95;        /* 5th/95th percentile grey level */
+    double sharpness;       /* mean squared gradient per pixel */
+    double ridge_coverage;  /* fraction of blocks with ridge-like texture, 0..1 */
+};
+
+/* minimums a capture must meet; zero disables a check */
+struct GT5XImageGate {
+    double min_contrast;
+    double min_sharpness;
+    double min_ridge_coverage;
+};
+
+class GT5XImage {
+    public:
+        GT5XImage();
+
+        void reset(void);
+
+        /* returns how many bytes were taken; anything past the last pixel is left */
+        size_t feed(const uint8_t * data, size_t len);
+        bool complete(void) const { return received == (size_t)GT5X_IMAGE_WIDTH * GT5X_IMAGE_HEIGHT; }
+        size_t bytes_received(void) const { return received; }
+
+        /* valid once complete() */
+        void metrics(GT5XImageMetrics * m) const;
+        bool passes(const GT5XImageGate & gate, GT5XImageMetrics * m = NULL) const;
+
+        /* the upscaled image, one buffered write each */
+        bool write_bmp(const char * path) const;
+        bool write_pgm(const char * path) const;
+        const uint8_t * pixels(void) const { return out; }
+
+        /* block variance above which a block counts as ridges */
+        void set_ridge_threshold(double stddev) { ridge_var = stddev * stddev; }
+
+    private:
+        void finish_row(void);
+        void finish_strip(void);
+
+        uint8_t row[GT5X_IMAGE_WIDTH];
+        uint8_t prev[GT5X_IMAGE_WIDTH];
+        uint8_t out[GT5X_OUT_WIDTH * GT5X_OUT_HEIGHT];
+        size_t received;
+        uint16_t rows_done;
+
+        /* running sums for the metrics */
+        uint64_t sum;
+        uint64_t sumsq;
+        uint64_t grad;
+        uint32_t grad_n;
+        uint32_t hist[256];
+
+        /* per block column, over the current strip of GT5X_RIDGE_BLOCK rows */
+        uint32_t block_sum[GT5X_IMAGE_WIDTH / GT5X_RIDGE_BLOCK];
+        uint64_t block_sumsq[GT5X_IMAGE_WIDTH / GT5X_RIDGE_BLOCK];
+        uint32_t ridge_blocks;
+        uint32_t total_blocks;
+        double ridge_var;
+};
+
+/* Undoes GT5X_RLESink (src/GT5XCompress.h) incrementally, handing the pixels 
+ * to an image as they come out */
+class GT5XRLEDecoder {
+    public:
+        GT5XRLEDecoder(GT5XImage * img);
+        void reset(void);
+
+        /* returns how many bytes were taken; stops once the image is complete */
+        size_t feed(const uint8_t * data, size_t len);
+        size_t bytes_in(void) const { return consumed; }
+
+    private:
+        void put(uint8_t delta, size_t count);
+
+        GT5XImage * img;
+        size_t consumed;
+        uint8_t prev;
+
+        /* position within the current packet */
+        uint8_t ctrl;
+        size_t literals_left;
+        bool have_ctrl;
+};
+
+#endif
@@ -0,0 +1,199 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Native counterpart of getImage.py: receives an image from the image_to_pc
+ * sketch, saves it upscaled as BMP or PGM, and judges whether it's good enough
+ * to make a template from. Text from the sketch is echoed until the '\t' that
+ * starts the image stream.
+ *
+ * usage: getImage -p /dev/ttyUSB0 [-b 115200] -o print.bmp [gate options]
+ *        getImage -i image.raw [-z 1] -o print.pgm [gate options]
+ *
+ * gate options: -c min_contrast -s min_sharpness -r min_ridge_coverage
+ *
+ * The sketch may send the image compressed with GT5X_RLESink, which is picked
+ * up from its start marker; -z 1 says a raw file is compressed.
+ *
+ * Metrics go to stdout as JSON. Exit status is 0 for a good image, 2 if it
+ * failed the gate (capture again) and 1 for any other error.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "GT5XImage.h"
+
+#define READ_TIMEOUT_MS     1000
+
+static speed_t baud_to_speed(long baud) {
+    switch (baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        default:        return 0;
+    }
+}
+
+static int open_port(const char * path, long baud) {
+    speed_t speed = baud_to_speed(baud);
+    if (speed == 0) {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+
+    return fd;
+}
+
+/* whatever's there within the timeout; 0 on timeout, -1 on error */
+static ssize_t read_some(int fd, uint8_t * buf, size_t len, int timeout_ms) {
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+
+    struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    int rc = select(fd + 1, &set, NULL, NULL, &tv);
+    if (rc <= 0)
+        return rc;
+
+    return read(fd, buf, len);
+}
+
+/* echo the sketch's messages until a start marker, then feed the image
+   straight from each read, however the bytes happen to be split up.
+   '\t' starts raw pixels, '\v' a GT5X_RLESink stream */
+static bool receive(int fd, bool framed, bool compressed, GT5XImage & img, size_t * link_bytes) {
+    uint8_t buf[4096];
+    bool started = !framed;
+    GT5XRLEDecoder rle(&img);
+    *link_bytes = 0;
+
+    while (!img.complete()) {
+        ssize_t n = read_some(fd, buf, sizeof(buf), READ_TIMEOUT_MS);
+        if (n < 0) {
+            perror("read");
+            return false;
+        }
+        if (n == 0) {
+            /* the sketch can sit idle for a while waiting for a finger */
+            if (!started)
+                continue;
+            fprintf(stderr, "timeout after %zu of %d pixels\n", img.bytes_received(),
+                    GT5X_IMAGE_WIDTH * GT5X_IMAGE_HEIGHT);
+            return false;
+        }
+
+        ssize_t pos = 0;
+        if (!started) {
+            while (pos < n && buf[pos] != '\t' && buf[pos] != '\v')
+                pos++;
+            fwrite(buf, 1, pos, stderr);
+            if (pos == n)
+                continue;
+
+            started = true;
+            compressed = buf[pos] == '\v';
+            pos++;
+        }
+
+        size_t used = compressed ? rle.feed(buf + pos, n - pos) : img.feed(buf + pos, n - pos);
+        *link_bytes += used;
+        pos += used;
+
+        /* trailing messages from the sketch */
+        if (pos < n)
+            fwrite(buf + pos, 1, n - pos, stderr);
+    }
+
+    return true;
+}
+
+static bool ends_with(const std::string & s, const char * suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int main(int argc, char ** argv) {
+    std::string port, input, output;
+    long baud = 115200;
+    GT5XImageGate gate = {0, 0, 0};
+    bool compressed = false;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "-p") port = argv[i + 1];
+        else if (opt == "-b") baud = atol(argv[i + 1]);
+        else if (opt == "-i") input = argv[i + 1];
+        else if (opt == "-o") output = argv[i + 1];
+        else if (opt == "-c") gate.min_contrast = atof(argv[i + 1]);
+        else if (opt == "-s") gate.min_sharpness = atof(argv[i + 1]);
+        else if (opt == "-r") gate.min_ridge_coverage = atof(argv[i + 1]);
+        else if (opt == "-z") compressed = atoi(argv[i + 1]) != 0;
+        else {
+            port.clear();
+            input.clear();
+            break;
+        }
+    }
+
+    if (port.empty() == input.empty()) {
+        fprintf(stderr, "usage: %s (-p port [-b baud] | -i raw_file [-z 1]) [-o out.bmp|out.pgm] "
+                        "[-c min_contrast] [-s min_sharpness] [-r min_ridge_coverage]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = port.empty() ? open(input.c_str(), O_RDONLY) : open_port(port.c_str(), baud);
+    if (fd < 0) {
+        if (port.empty())
+            perror(input.c_str());
+        return 1;
+    }
+
+    static GT5XImage img;
+    size_t link_bytes;
+    bool ok = receive(fd, !port.empty(), compressed, img, &link_bytes);
+    close(fd);
+    if (!ok)
+        return 1;
+
+    if (!output.empty()) {
+        bool saved = ends_with(output, ".pgm") ? img.write_pgm(output.c_str()) : img.write_bmp(output.c_str());
+        if (!saved) {
+            perror(output.c_str());
+            return 1;
+        }
+    }
+
+    GT5XImageMetrics m;
+    bool good = img.passes(gate, &m);
+
+    printf("{\"link_bytes\": %zu, \"mean\": %.1f, \"contrast\": %.1f, \"p5\": %u, \"p95\": %u, "
+           "\"sharpness\": %.1f, \"ridge_coverage\": %.3f, \"pass\": %s}\n",
+           link_bytes, m.mean, m.contrast, m.p5, m.p95, m.sharpness, m.ridge_coverage, good ? "true" : "false");
+
+    return good ? 0 : 2;
+}
@@ -1,7 +1,7 @@
 # Written by Brian Ejike (2018)
 # Distributed under the MIT License
 
-import serial, time
+import serial, time, itertools
 
 BG_BYTE = 66
 
@@ -13,8 +13,12 @@ HEIGHT = 120
 DEPTH = 8
 PAYLOAD_SZ = WIDTH * HEIGHT
 
-image_raw = [0] * PAYLOAD_SZ
-image_final = [BG_BYTE] * (TOTAL_WIDTH * TOTAL_HEIGHT)
+# stream start markers sent by the image_to_pc sketch
+RAW_START = '\t'
+RLE_START = '\v'
+
+# see src/GT5XCompress.h
+RLE_MIN_RUN = 3
 
 portSettings = ['', 0]
 
@@ -49,6 +53,39 @@ def assembleHeader(width, height, depth, cTable=False):
     #header[50:54] = (0).to_bytes(4, byteorder='little')
     return header
 
+# undo GT5X_RLESink: control bytes lead runs and literals of pixel deltas
+def readCompressed(ser, count):
+    deltas = bytearray()
+    while len(deltas) < count:
+        ctrl = ser.read()
+        if not ctrl:
+            return None
+        ctrl = ctrl[0]
+        if ctrl >= 0x80:
+            val = ser.read()
+            if not val:
+                return None
+            deltas += val * (ctrl - 0x80 + RLE_MIN_RUN)
+        else:
+            lit = ser.read(ctrl + 1)
+            if len(lit) != ctrl + 1:
+                return None
+            deltas += lit
+    return bytes(itertools.accumulate(deltas, lambda a, b: (a + b) & 0xFF))
+
+def readRaw(ser, count):
+    data = ser.read(count)
+    return data if len(data) == count else None
+
+# 2x upscale, each pixel doubled across and each row doubled down
+def upscale(image):
+    final = bytearray()
+    for row in range(HEIGHT):
+        line = bytearray(TOTAL_WIDTH)
+        line[0::2] = line[1::2] = image[row*WIDTH : (row + 1)*WIDTH]
+        final += line * 2
+    return final
+
 def options():
     print("Options:")
     print("\tPress 1 to enter serial port settings")
@@ -69,7 +106,7 @@ def getPrint():
     '''
     First enter the port settings with menu option 1:
     >>> Enter Arduino serial port number: COM13
-    >>> Enter serial port baud rate: 57600
+    >>> Enter serial port baud rate: 115200
 
     Then enter the filename of the image with menu option 2: 
     >>> Enter filename/path of output file (without extension): myprints
@@ -107,32 +144,25 @@ def getPrint():
             
             # assumes everything recved at first is printable ascii
             curr = ser.read().decode()
-            # based on the image_to_pc sketch, \t indicates start of the stream
-            if curr != '\t':
+            # based on the image_to_pc sketch, \t or \v indicates start of the stream
+            if curr != RAW_START and curr != RLE_START:
                 # print the debug messages from arduino running the image_to_pc sketch
                 print(curr, end='')
                 continue
-                
-            for i in range(PAYLOAD_SZ): # start recving image
-                byte = ser.read()
-                # if we get nothing after the 1 sec timeout period
-                if not byte:
-                    print("Timeout!")
-                    out.close()  # close port and file
-                    ser.close()
-                    return False
-                image_raw[i] = byte[0]
-
-            # interpolate (ported directly from sdk)
-            for row in range(HEIGHT):
-                for col in range(WIDTH):
-                    image_final[TOTAL_WIDTH*(2*row + 0) + (2*col + 0)] = image_raw[row*WIDTH + col]
-                    image_final[TOTAL_WIDTH*(2*row + 0) + (2*col + 1)] = image_raw[row*WIDTH + col]
-                    image_final[TOTAL_WIDTH*(2*row + 1) + (2*col + 0)] = image_raw[row*WIDTH + col]
-                    image_final[TOTAL_WIDTH*(2*row + 1) + (2*col + 1)] = image_raw[row*WIDTH + col]
-
-            for byte in image_final:
-                out.write(byte.to_bytes(1, byteorder='little'))
+            
+            # the whole image in one go; None if we time out part way
+            if curr == RLE_START:
+                image_raw = readCompressed(ser, PAYLOAD_SZ)
+            else:
+                image_raw = readRaw(ser, PAYLOAD_SZ)
+            
+            if image_raw is None:
+                print("Timeout!")
+                out.close()  # close port and file
+                ser.close()
+                return False
+
+            out.write(upscale(image_raw))
                 
             out.close()  # close file
             print('Image saved as', out.name)
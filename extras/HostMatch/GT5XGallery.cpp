@@ -0,0 +1,266 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define GALLERY_X86
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define GALLERY_NEON
+#endif
+
+#include "GT5XGallery.h"
+
+/* 8-bit counters are summed in two halves so neither can pass 255 */
+#define HALF_SZ     (GT5X_TEMPLATESZ / 2)
+
+/* scores[i] = number of positions j where block row j, lane i equals probe[j] */
+static void score_block_scalar(const uint8_t * block, const uint8_t * probe, uint16_t * scores) {
+    for (int i = 0; i < GALLERY_BLOCK; i++)
+        scores[i] = 0;
+
+    for (int j = 0; j < GT5X_TEMPLATESZ; j++) {
+        const uint8_t * row = block + (size_t)j * GALLERY_BLOCK;
+        uint8_t q = probe[j];
+        for (int i = 0; i < GALLERY_BLOCK; i++)
+            scores[i] += (row[i] == q);
+    }
+}
+
+#ifdef GALLERY_X86
+/* a lane that matches compares to 0xFF, i.e. -1, so subtracting it counts up */
+static void score_block_sse2(const uint8_t * block, const uint8_t * probe, uint16_t * scores) {
+    uint8_t lo[GALLERY_BLOCK], hi[GALLERY_BLOCK];
+
+    for (int half = 0; half < 2; half++) {
+        __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+        int start = half * HALF_SZ;
+
+        for (int j = start; j < start + HALF_SZ; j++) {
+            const __m128i * row = (const __m128i *)(block + (size_t)j * GALLERY_BLOCK);
+            __m128i q = _mm_set1_epi8((char)probe[j]);
+            acc0 = _mm_sub_epi8(acc0, _mm_cmpeq_epi8(_mm_load_si128(row), q));
+            acc1 = _mm_sub_epi8(acc1, _mm_cmpeq_epi8(_mm_load_si128(row + 1), q));
+        }
+
+        uint8_t * out = half ? hi : lo;
+        _mm_storeu_si128((__m128i *)out, acc0);
+        _mm_storeu_si128((__m128i *)(out + 16), acc1);
+    }
+
+    for (int i = 0; i < GALLERY_BLOCK; i++)
+        scores[i] = (uint16_t)lo[i] + hi[i];
+}
+
+__attribute__((target("avx2")))
+static void score_block_avx2(const uint8_t * block, const uint8_t * probe, uint16_t * scores) {
+    uint8_t lo[GALLERY_BLOCK], hi[GALLERY_BLOCK];
+
+    for (int half = 0; half < 2; half++) {
+        __m256i acc = _mm256_setzero_si256();
+        int start = half * HALF_SZ;
+
+        for (int j = start; j < start + HALF_SZ; j++) {
+            __m256i row = _mm256_load_si256((const __m256i *)(block + (size_t)j * GALLERY_BLOCK));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(row, _mm256_set1_epi8((char)probe[j])));
+        }
+
+        _mm256_storeu_si256((__m256i *)(half ? hi : lo), acc);
+    }
+
+    for (int i = 0; i < GALLERY_BLOCK; i++)
+        scores[i] = (uint16_t)lo[i] + hi[i];
+}
+#endif
+
+#ifdef GALLERY_NEON
+static void score_block_neon(const uint8_t * block, const uint8_t * probe, uint16_t * scores) {
+    uint8_t lo[GALLERY_BLOCK], hi[GALLERY_BLOCK];
+
+    for (int half = 0; half < 2; half++) {
+        uint8x16_t acc0 = vdupq_n_u8(0), acc1 = vdupq_n_u8(0);
+        int start = half * HALF_SZ;
+
+        for (int j = start; j < start + HALF_SZ; j++) {
+            const uint8_t * row = block + (size_t)j * GALLERY_BLOCK;
+            uint8x16_t q = vdupq_n_u8(probe[j]);
+            acc0 = vsubq_u8(acc0, vceqq_u8(vld1q_u8(row), q));
+            acc1 = vsubq_u8(acc1, vceqq_u8(vld1q_u8(row + 16), q));
+        }
+
+        uint8_t * out = half ? hi : lo;
+        vst1q_u8(out, acc0);
+        vst1q_u8(out + 16, acc1);
+    }
+
+    for (int i = 0; i < GALLERY_BLOCK; i++)
+        scores[i] = (uint16_t)lo[i] + hi[i];
+}
+#endif
+
+GT5XGallery::GT5XGallery(size_t reserve_n) :
+    data(NULL), blocks_alloc(0), count(0), kern(GALLERY_KERNEL_SCALAR), score_block(score_block_scalar)
+{
+    set_kernel(GALLERY_KERNEL_AUTO);
+    reserve(reserve_n);
+}
+
+GT5XGallery::~GT5XGallery() {
+    free(data);
+}
+
+void GT5XGallery::reserve(size_t n) {
+    size_t blocks = (n + GALLERY_BLOCK - 1) / GALLERY_BLOCK;
+    if (blocks <= blocks_alloc)
+        return;
+
+    /* rows are loaded aligned */
+    void * p = NULL;
+    if (posix_memalign(&p, 64, blocks * block_bytes()) != 0)
+        throw std::bad_alloc();
+
+    if (data != NULL)
+        memcpy(p, data, blocks_alloc * block_bytes());
+    free(data);
+
+    /* unused lanes stay zero; they're never reported since index >= count */
+    memset((uint8_t *)p + blocks_alloc * block_bytes(), 0, (blocks - blocks_alloc) * block_bytes());
+
+    data = (uint8_t *)p;
+    blocks_alloc = blocks;
+    ids.reserve(blocks * GALLERY_BLOCK);
+}
+
+void GT5XGallery::add(const uint8_t * tmpl, uint32_t id) {
+    if (count == blocks_alloc * GALLERY_BLOCK)
+        reserve(count ? count * 2 : GALLERY_BLOCK);
+
+    uint8_t * block = data + (count / GALLERY_BLOCK) * block_bytes();
+    size_t lane = count % GALLERY_BLOCK;
+
+    for (int j = 0; j < GT5X_TEMPLATESZ; j++)
+        block[(size_t)j * GALLERY_BLOCK + lane] = tmpl[j];
+
+    ids.push_back(id);
+    count++;
+}
+
+void GT5XGallery::get(size_t index, uint8_t * tmpl) const {
+    const uint8_t * block = data + (index / GALLERY_BLOCK) * block_bytes();
+    size_t lane = index % GALLERY_BLOCK;
+
+    for (int j = 0; j < GT5X_TEMPLATESZ; j++)
+        tmpl[j] = block[(size_t)j * GALLERY_BLOCK + lane];
+}
+
+void GT5XGallery::best_in(size_t first_block, size_t last_block, const uint8_t * probe, GalleryMatch * best) const {
+    uint16_t scores[GALLERY_BLOCK];
+
+    for (size_t b = first_block; b < last_block; b++) {
+        score_block(data + b * block_bytes(), probe, scores);
+
+        size_t base = b * GALLERY_BLOCK;
+        size_t lanes = count - base < GALLERY_BLOCK ? count - base : GALLERY_BLOCK;
+
+        /* ties go to the lowest index, whichever thread gets there first */
+        for (size_t i = 0; i < lanes; i++) {
+            if (scores[i] > best->score || (scores[i] == best->score && base + i < best->index)) {
+                best->score = scores[i];
+                best->index = (uint32_t)(base + i);
+            }
+        }
+    }
+}
+
+bool GT5XGallery::identify(const uint8_t * probe, uint16_t thresh, GalleryMatch * out, ThreadPool * pool) const {
+    GalleryMatch best = {GALLERY_NO_MATCH, GALLERY_NO_MATCH, 0};
+    size_t blocks = (count + GALLERY_BLOCK - 1) / GALLERY_BLOCK;
+
+    if (pool == NULL || pool->size() == 1) {
+        best_in(0, blocks, probe, &best);
+    }
+    else {
+        /* one result slot per thread, padded apart so they don't share a line */
+        struct Slot {
+            GalleryMatch m;
+            char pad[64 - sizeof(GalleryMatch)];
+        };
+        std::vector<Slot> slots(pool->size());
+        for (size_t i = 0; i < slots.size(); i++)
+            slots[i].m = best;
+
+        pool->run(blocks, 64, [&](size_t begin, size_t end, unsigned worker) {
+            best_in(begin, end, probe, &slots[worker].m);
+        });
+
+        for (size_t i = 0; i < slots.size(); i++) {
+            const GalleryMatch & m = slots[i].m;
+            if (m.score > best.score || (m.score == best.score && m.index < best.index))
+                best = m;
+        }
+    }
+
+    if (best.index == GALLERY_NO_MATCH || best.score < thresh) {
+        out->id = GALLERY_NO_MATCH;
+        out->index = GALLERY_NO_MATCH;
+        out->score = best.score;
+        return false;
+    }
+
+    best.id = ids[best.index];
+    *out = best;
+    return true;
+}
+
+bool GT5XGallery::set_kernel(GalleryKernel k) {
+    switch (k) {
+        case GALLERY_KERNEL_AUTO:
+#if defined(GALLERY_X86)
+            if (set_kernel(GALLERY_KERNEL_AVX2))
+                return true;
+            return set_kernel(GALLERY_KERNEL_SSE2);
+#elif defined(GALLERY_NEON)
+            return set_kernel(GALLERY_KERNEL_NEON);
+#else
+            return set_kernel(GALLERY_KERNEL_SCALAR);
+#endif
+        case GALLERY_KERNEL_SCALAR:
+            score_block = score_block_scalar;
+            break;
+#ifdef GALLERY_X86
+        case GALLERY_KERNEL_SSE2:
+            score_block = score_block_sse2;
+            break;
+        case GALLERY_KERNEL_AVX2:
+            if (!__builtin_cpu_supports("avx2"))
+                return false;
+            score_block = score_block_avx2;
+            break;
+#endif
+#ifdef GALLERY_NEON
+        case GALLERY_KERNEL_NEON:
+            score_block = score_block_neon;
+            break;
+#endif
+        default:
+            return false;
+    }
+
+    kern = k;
+    return true;
+}
+
+const char * GT5XGallery::kernel_name(GalleryKernel k) {
+    switch (k) {
+        case GALLERY_KERNEL_AUTO:   return "auto";
+        case GALLERY_KERNEL_SCALAR: return "scalar";
+        case GALLERY_KERNEL_SSE2:   return "sse2";
+        case GALLERY_KERNEL_AVX2:   return "avx2";
+        case GALLERY_KERNEL_NEON:   return "neon";
+    }
+    return "?";
+}
@@ -0,0 +1,86 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Host-side 1:N identify over an in-memory gallery of GT5X templates.
+ *
+ * Templates are stored blocked and transposed: each block holds GALLERY_BLOCK
+ * templates, laid out byte-position-major, so byte j of all the templates in a
+ * block sits in one contiguous GALLERY_BLOCK-byte row. Scoring a probe against a
+ * block is then a straight walk through memory, comparing one broadcast probe
+ * byte against a whole row per SIMD instruction.
+ *
+ * The similarity is the one the emulator uses (equal bytes at equal positions,
+ * out of GT5X_TEMPLATESZ). The module's real matcher is not public; anything
+ * that scores a block at a time can be dropped in as another kernel. */
+
+#ifndef GT5X_GALLERY_H
+#define GT5X_GALLERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "GT5X.h"
+#include "ThreadPool.h"
+
+/* templates per block; one AVX2 register row */
+#define GALLERY_BLOCK           32
+
+struct GalleryMatch {
+    uint32_t id;            /* caller's ID for the template, GALLERY_NO_MATCH if none */
+    uint32_t index;         /* position in the gallery */
+    uint16_t score;
+};
+
+#define GALLERY_NO_MATCH        0xFFFFFFFFu
+
+enum GalleryKernel {
+    GALLERY_KERNEL_AUTO,
+    GALLERY_KERNEL_SCALAR,
+    GALLERY_KERNEL_SSE2,
+    GALLERY_KERNEL_AVX2,
+    GALLERY_KERNEL_NEON
+};
+
+class GT5XGallery {
+    public:
+        GT5XGallery(size_t reserve = 0);
+        ~GT5XGallery();
+
+        void clear(void) { count = 0; ids.clear(); }
+        void reserve(size_t n);
+        void add(const uint8_t * tmpl, uint32_t id);
+        size_t size(void) const { return count; }
+        size_t bytes(void) const { return blocks_alloc * block_bytes(); }
+
+        /* copies template `index` back out of the transposed layout */
+        void get(size_t index, uint8_t * tmpl) const;
+
+        /* best-scoring template at or above thresh; returns false if none.
+           With a pool, blocks are shared out across its threads */
+        bool identify(const uint8_t * probe, uint16_t thresh, GalleryMatch * out, ThreadPool * pool = NULL) const;
+
+        /* false if the kernel isn't built in or the CPU lacks it */
+        bool set_kernel(GalleryKernel k);
+        GalleryKernel kernel(void) const { return kern; }
+        static const char * kernel_name(GalleryKernel k);
+
+    private:
+        typedef void (*BlockFn)(const uint8_t * block, const uint8_t * probe, uint16_t * scores);
+
+        static size_t block_bytes(void) { return (size_t)GT5X_TEMPLATESZ * GALLERY_BLOCK; }
+        void best_in(size_t first_block, size_t last_block, const uint8_t * probe, GalleryMatch * best) const;
+
+        uint8_t * data;
+        size_t blocks_alloc;
+        size_t count;
+        std::vector<uint32_t> ids;
+
+        GalleryKernel kern;
+        BlockFn score_block;
+
+        GT5XGallery(const GT5XGallery &);
+        GT5XGallery & operator=(const GT5XGallery &);
+};
+
+#endif
@@ -0,0 +1,91 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads) :
+    task(NULL), total(0), chunk(1), next(0), active(0), generation(0), stopping(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned i = 1; i < threads; i++)
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void ThreadPool::run(size_t n, size_t grain, const Task & t) {
+    if (n == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    /* a few chunks per thread evens out the stragglers */
+    size_t per = (n + size() * 4 - 1) / (size() * 4);
+    size_t c = per > grain ? per : grain;
+
+    if (workers.empty() || c >= n) {
+        t(0, n, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        task = &t;
+        total = n;
+        chunk = c;
+        next.store(0);
+        active = (unsigned)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    do_chunks(0);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return active == 0; });
+    task = NULL;
+}
+
+void ThreadPool::do_chunks(unsigned idx) {
+    while (true) {
+        size_t begin = next.fetch_add(chunk);
+        if (begin >= total)
+            break;
+
+        size_t end = begin + chunk < total ? begin + chunk : total;
+        (*task)(begin, end, idx);
+    }
+}
+
+void ThreadPool::worker_loop(unsigned idx) {
+    uint64_t seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        do_chunks(idx);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--active == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,54 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Fixed set of worker threads for splitting a range across cores. run() hands
+ * out [begin, end) chunks to the workers and the calling thread alike, and
+ * returns once every chunk is done. */
+
+#ifndef GT5X_THREAD_POOL_H
+#define GT5X_THREAD_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    public:
+        typedef std::function<void (size_t begin, size_t end, unsigned worker)> Task;
+
+        /* 0 for one thread per core; the caller counts as one of them */
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        unsigned size(void) const { return (unsigned)workers.size() + 1; }
+
+        /* split [0, n) into chunks of at least `grain` */
+        void run(size_t n, size_t grain, const Task & task);
+
+    private:
+        void worker_loop(unsigned idx);
+        void do_chunks(unsigned idx);
+
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const Task * task;
+        size_t total;
+        size_t chunk;
+        std::atomic<size_t> next;
+        unsigned active;
+        uint64_t generation;
+        bool stopping;
+
+        ThreadPool(const ThreadPool &);
+        ThreadPool & operator=(const ThreadPool &);
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Captures a probe template from the emulated sensor with GT5X_MAKETEMPLATE,
+ * then times 1:N identify against galleries of growing size for every scoring
+ * kernel the CPU supports and every thread count up to -t. Results are printed
+ * as one JSON document on stdout.
+ *
+ * usage: match_bench [-n iters] [-m max_gallery] [-t max_threads]
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "GT5X.h"
+#include "GT5XEmulator.h"
+#include "GT5XGallery.h"
+
+#define PROBE_KEY       777
+#define PROBE_ID        500
+
+static uint64_t host_now_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t median(std::vector<uint64_t> v) {
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+/* the sensor side: capture, extract a template, pull it over the link */
+static bool capture_probe(uint8_t * probe, uint64_t * virt_us) {
+    GT5XEmulator emu(3000, 115200);
+    GT5X finger(&emu);
+
+    if (!finger.begin())
+        return false;
+
+    emu.place_finger(PROBE_KEY);
+    uint64_t t0 = hostsim_now_us();
+
+    bool ok = finger.capture_finger() == GT5X_OK
+           && finger.make_template() == GT5X_OK
+           && finger.read_raw(GT5X_OUTPUT_TO_BUFFER, probe, GT5X_TEMPLATESZ);
+
+    *virt_us = hostsim_now_us() - t0;
+    return ok;
+}
+
+int main(int argc, char ** argv) {
+    uint32_t iters = 5;
+    size_t max_gallery = 1000000;
+    unsigned max_threads = std::thread::hardware_concurrency();
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "-n") iters = atoi(argv[i + 1]);
+        else if (opt == "-m") max_gallery = atol(argv[i + 1]);
+        else if (opt == "-t") max_threads = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "usage: %s [-n iters] [-m max_gallery] [-t max_threads]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iters == 0)
+        iters = 1;
+    if (max_threads == 0)
+        max_threads = 1;
+
+    uint8_t probe[GT5X_TEMPLATESZ];
+    uint64_t capture_us;
+    if (!capture_probe(probe, &capture_us)) {
+        fprintf(stderr, "could not get a template from the sensor\n");
+        return 1;
+    }
+
+    std::vector<unsigned> thread_counts;
+    for (unsigned t = 1; t < max_threads; t *= 2)
+        thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    static const GalleryKernel kernels[] = {
+        GALLERY_KERNEL_SCALAR, GALLERY_KERNEL_SSE2, GALLERY_KERNEL_AVX2, GALLERY_KERNEL_NEON
+    };
+
+    printf("{\n  \"version\": 1,\n  \"iters\": %u, \"hw_threads\": %u,\n", iters, std::thread::hardware_concurrency());
+    printf("  \"probe\": {\"capture_to_template_us\": %llu},\n", (unsigned long long)capture_us);
+    printf("  \"results\": [\n");
+
+    GT5XGallery gallery;
+    uint8_t tmpl[GT5X_TEMPLATESZ];
+    bool first = true;
+
+    for (size_t n = 1000; n <= max_gallery; n *= 10) {
+        /* grow the gallery; the enrolled copy of the probe's finger goes in 
+           the middle of the first one and stays there */
+        gallery.reserve(n);
+        while (gallery.size() < n) {
+            uint32_t id = (uint32_t)gallery.size();
+            GT5XEmulator::make_template(id == PROBE_ID ? PROBE_KEY : (int32_t)id + 1000000, tmpl);
+            gallery.add(tmpl, id);
+        }
+
+        for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+            if (!gallery.set_kernel(kernels[k]))
+                continue;
+
+            for (size_t t = 0; t < thread_counts.size(); t++) {
+                ThreadPool pool(thread_counts[t]);
+                std::vector<uint64_t> ns;
+                GalleryMatch m;
+                bool found = false;
+
+                for (uint32_t i = 0; i < iters; i++) {
+                    uint64_t h0 = host_now_ns();
+                    found = gallery.identify(probe, 450, &m, &pool);
+                    ns.push_back(host_now_ns() - h0);
+                }
+
+                uint64_t med = median(ns);
+                double per_sec = med ? n * 1e9 / med : 0;
+
+                printf("%s    {\"gallery\": %lu, \"kernel\": \"%s\", \"threads\": %u, \"ns_p50\": %llu,\n",
+                       first ? "" : ",\n", (unsigned long)n, GT5XGallery::kernel_name(kernels[k]),
+                       pool.size(), (unsigned long long)med);
+                printf("     \"templates_per_sec\": %.0f, \"gb_per_sec\": %.2f, \"found\": %s, \"id\": %ld, \"score\": %u}",
+                       per_sec, per_sec * GT5X_TEMPLATESZ / 1e9, (found && m.id == PROBE_ID) ? "true" : "false",
+                       found ? (long)m.id : -1L, m.score);
+                first = false;
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
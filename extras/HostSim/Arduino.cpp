@@ -0,0 +1,157 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <stdio.h>
+#include "Arduino.h"
+
+static uint64_t clock_us = 0;
+static uint32_t poll_cost_us = 1;
+static uint64_t yields = 0;
+static uint64_t slept_us = 0;
+
+HostSerial Serial;
+
+unsigned long millis(void) {
+    return (unsigned long)(clock_us / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)clock_us;
+}
+
+void delay(unsigned long ms) {
+    clock_us += (uint64_t)ms * 1000;
+}
+
+void yield(void) {
+    yields++;
+    clock_us += poll_cost_us;
+}
+
+uint64_t hostsim_now_us(void) {
+    return clock_us;
+}
+
+void hostsim_advance_us(uint64_t us) {
+    clock_us += us;
+}
+
+void hostsim_sleep_us(uint64_t us) {
+    clock_us += us;
+    slept_us += us;
+}
+
+uint64_t hostsim_slept_us(void) {
+    return slept_us;
+}
+
+void hostsim_set_poll_cost_us(uint32_t us) {
+    poll_cost_us = us ? us : 1;
+}
+
+uint64_t hostsim_yield_count(void) {
+    return yields;
+}
+
+void hostsim_reset_yield_count(void) {
+    yields = 0;
+}
+
+/* Print */
+
+size_t Print::write(const uint8_t * buf, size_t len) {
+    size_t n = 0;
+    while (len--) {
+        if (write(*buf++) == 0)
+            break;
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(const char * str) {
+    return write(str);
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned long val, int base) {
+    char buf[8 * sizeof(long) + 1];
+    char * p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+
+    if (base < 2)
+        base = 10;
+
+    do {
+        unsigned long d = val % base;
+        *--p = d < 10 ? '0' + d : 'A' + d - 10;
+        val /= base;
+    } while (val);
+
+    return write(p);
+}
+
+size_t Print::print(long val, int base) {
+    if (base == DEC && val < 0)
+        return print('-') + print((unsigned long)-val, base);
+    return print((unsigned long)val, base);
+}
+
+size_t Print::println(void) {
+    return write("\r\n");
+}
+
+/* Stream */
+
+int Stream::timedRead(void) {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0)
+            return c;
+        yield();
+    } while (millis() - start < _timeout);
+
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t * buf, size_t len) {
+    size_t count = 0;
+    while (count < len) {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        *buf++ = (uint8_t)c;
+        count++;
+    }
+    return count;
+}
+
+/* HostSerial */
+
+int HostSerial::available(void) {
+    return 0;
+}
+
+int HostSerial::read(void) {
+    return -1;
+}
+
+int HostSerial::peek(void) {
+    return -1;
+}
+
+void HostSerial::flush(void) {
+    fflush(stdout);
+}
+
+size_t HostSerial::write(uint8_t c) {
+    return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HostSerial::write(const uint8_t * buf, size_t len) {
+    return fwrite(buf, 1, len, stdout);
+}
@@ -0,0 +1,97 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Minimal stand-in for the Arduino core, just enough to build src/GT5X.cpp
+ * on a desktop host. Time is virtual: millis()/micros() only move forward
+ * when the driver calls yield() or delay(), which keeps runs deterministic
+ * regardless of host load. */
+
+#ifndef GT5X_HOSTSIM_ARDUINO_H
+#define GT5X_HOSTSIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define DEC     10
+#define HEX     16
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void yield(void);
+
+/* virtual clock control, host-only */
+uint64_t hostsim_now_us(void);
+void hostsim_advance_us(uint64_t us);
+
+/* how far the clock moves on each yield(), i.e. the cost of one poll */
+void hostsim_set_poll_cost_us(uint32_t us);
+
+/* moves the clock like hostsim_advance_us(), but counts as time the core spent 
+   asleep rather than running, e.g. waiting for an interrupt */
+void hostsim_sleep_us(uint64_t us);
+uint64_t hostsim_slept_us(void);
+
+/* number of yield() calls so far, i.e. busy-poll iterations */
+uint64_t hostsim_yield_count(void);
+void hostsim_reset_yield_count(void);
+
+class Print {
+    public:
+        virtual ~Print() {}
+
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t * buf, size_t len);
+        size_t write(const char * str) { return write((const uint8_t *)str, strlen(str)); }
+
+        size_t print(const char * str);
+        size_t print(char c);
+        size_t print(long val, int base = DEC);
+        size_t print(unsigned long val, int base = DEC);
+        size_t print(int val, int base = DEC) { return print((long)val, base); }
+        size_t print(unsigned int val, int base = DEC) { return print((unsigned long)val, base); }
+
+        size_t println(void);
+        template <typename T> size_t println(T val) { size_t n = print(val); return n + println(); }
+        template <typename T> size_t println(T val, int base) { size_t n = print(val, base); return n + println(); }
+};
+
+class Stream : public Print {
+    public:
+        Stream() : _timeout(1000) {}
+
+        virtual int available(void) = 0;
+        virtual int read(void) = 0;
+        virtual int peek(void) = 0;
+        virtual void flush(void) {}
+
+        void setTimeout(unsigned long timeout) { _timeout = timeout; }
+        size_t readBytes(uint8_t * buf, size_t len);
+        size_t readBytes(char * buf, size_t len) { return readBytes((uint8_t *)buf, len); }
+
+    protected:
+        unsigned long _timeout;
+        int timedRead(void);
+};
+
+/* console on stdout/stdin */
+class HostSerial : public Stream {
+    public:
+        void begin(unsigned long baud) { (void)baud; }
+
+        int available(void);
+        int read(void);
+        int peek(void);
+        void flush(void);
+
+        size_t write(uint8_t c);
+        size_t write(const uint8_t * buf, size_t len);
+        using Print::write;
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,124 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* GT5X_Transport over a file descriptor (a tty, pty or socket) for running the
+ * driver against a real module from Linux. A reader thread drains the descriptor
+ * into a queue and signals a condition variable, and wait() sleeps on it, so a
+ * blocking command costs no CPU while the module works:
+ *
+ *     GT5X_CondTransport link(fd);
+ *     GT5X finger(&link);
+ *     finger.set_wait_hook(GT5X_CondTransport::wait, &link);
+ *
+ * HostSim's clock only moves when told to, so the time spent asleep is added to it.
+ * Build with -pthread. */
+
+#ifndef GT5X_COND_TRANSPORT_H
+#define GT5X_COND_TRANSPORT_H
+
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Arduino.h"
+#include "GT5X.h"
+
+/* how often the reader thread looks up to see if it should stop */
+#define GT5X_COND_STOP_POLL_MS      50
+
+class GT5X_CondTransport : public GT5X_Transport {
+    public:
+        GT5X_CondTransport(int port_fd) : fd(port_fd), stopping(false) {
+            reader = std::thread(&GT5X_CondTransport::run, this);
+        }
+
+        ~GT5X_CondTransport() {
+            stopping = true;
+            reader.join();
+        }
+
+        uint16_t available(void) {
+            std::lock_guard<std::mutex> hold(lock);
+            return rx.size() < 0xFFFF ? (uint16_t)rx.size() : 0xFFFF;
+        }
+
+        uint16_t read(uint8_t * buf, uint16_t len) {
+            std::lock_guard<std::mutex> hold(lock);
+            uint16_t n = 0;
+            while (n < len && !rx.empty()) {
+                buf[n++] = rx.front();
+                rx.pop_front();
+            }
+            return n;
+        }
+
+        void write(const uint8_t * data, uint16_t len) {
+            while (len != 0) {
+                ssize_t n = ::write(fd, data, len);
+                if (n <= 0)
+                    return;
+                data += n;
+                len -= n;
+            }
+        }
+
+        void discard(void) {
+            std::lock_guard<std::mutex> hold(lock);
+            rx.clear();
+        }
+
+        /* GT5X_WaitHook, ctx is the transport */
+        static void wait(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+            (void)port;
+            GT5X_CondTransport * self = (GT5X_CondTransport *)ctx;
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+            {
+                std::unique_lock<std::mutex> hold(self->lock);
+                self->ready.wait_for(hold, std::chrono::milliseconds(max_ms != 0 ? max_ms : 1),
+                                     [self] { return !self->rx.empty(); });
+            }
+
+            hostsim_sleep_us(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - t0).count());
+        }
+
+    private:
+        void run(void) {
+            uint8_t buf[256];
+            struct pollfd pfd = {fd, POLLIN, 0};
+
+            while (!stopping) {
+                if (::poll(&pfd, 1, GT5X_COND_STOP_POLL_MS) <= 0)
+                    continue;
+
+                ssize_t n = ::read(fd, buf, sizeof(buf));
+                if (n <= 0) {
+                    /* hung up, nothing more will come */
+                    if (pfd.revents & (POLLHUP | POLLERR))
+                        return;
+                    continue;
+                }
+
+                {
+                    std::lock_guard<std::mutex> hold(lock);
+                    rx.insert(rx.end(), buf, buf + n);
+                }
+                ready.notify_one();
+            }
+        }
+
+        int fd;
+        std::atomic<bool> stopping;
+        std::thread reader;
+        std::mutex lock;
+        std::condition_variable ready;
+        std::deque<uint8_t> rx;
+};
+
+#endif
@@ -0,0 +1,731 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <math.h>
+#include <algorithm>
+
+#include "GT5XEmulator.h"
+
+#define EMU_FWVERSION           0x20180101
+#define EMU_ISO_MAX_SIZE        (GT5X_TEMPLATESZ * 2)
+#define EMU_CAPTURE_NOISE       8       /* bytes that differ between captures of one finger */
+#define EMU_BG_PIXEL            66
+#define EMU_ACK_DELAY_US        2000    /* first ACK of a command that has a data phase */
+
+static const uint8_t cmd_preamble[] = {GT5X_CMD_START_CODE1, GT5X_CMD_START_CODE2,
+                                       (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+static const uint8_t data_preamble[] = {GT5X_DATA_START_CODE1, GT5X_DATA_START_CODE2,
+                                        (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+
+static uint32_t xorshift(uint32_t * s) {
+    uint32_t x = *s;
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    return *s = x;
+}
+
+static uint32_t read_le32(const uint8_t * p) {
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+GT5XEmulator::GT5XEmulator(uint16_t capacity, uint32_t baud) :
+    cap(capacity), hbaud(baud), mbaud(baud),
+    tx_free_at(0), rx_free_at(0), rx_state(RX_HEADER), rx_header(0), rx_expect(0), rx_is_data(false),
+    data_cmd(0), data_len(0), data_param(0), busy_until(0), identify_cost_us(400),
+    used(capacity, false), db((size_t)capacity * GT5X_TEMPLATESZ), match_thresh(450),
+    finger_key(GT5X_EMU_NO_FINGER), finger_good(true), led(false), captured(GT5X_EMU_NO_FINGER),
+    enroll_id(-2), enroll_pass(0), enroll_key(GT5X_EMU_NO_FINGER),
+    upgrade_total(0), upgrade_got(0), upgrade_sum(0), upgrade_chunk(GT5X_UPGRADE_CHUNKSZ),
+    drop_rate(0), corrupt_rate(0), corrupt_data_only(false), rng(0x1234567)
+{
+    for (int i = 0; i < 256; i++)
+        delays[i] = 2000;
+
+    delays[GT5X_OPEN] = 10000;
+    delays[GT5X_CMOSLED] = 5000;
+    delays[GT5X_CHANGEBAUDRATE] = 5000;
+    delays[GT5X_STARTENROLL] = 5000;
+    delays[GT5X_ENROLL1] = 300000;
+    delays[GT5X_ENROLL2] = 300000;
+    delays[GT5X_ENROLL3] = 400000;
+    delays[GT5X_DELETEID] = 20000;
+    delays[GT5X_DELETEALL] = 100000;
+    delays[GT5X_VERIFY1_1] = 100000;
+    delays[GT5X_IDENTIFY1_N] = 50000;
+    delays[GT5X_VERIFYTEMPLATE1_1] = 100000;
+    delays[GT5X_IDENTIFYTEMPLATE1_N] = 50000;
+    delays[GT5X_CAPTUREFINGER] = 150000;
+    delays[GT5X_MAKETEMPLATE] = 100000;
+    delays[GT5X_GETIMAGE] = 150000;
+    delays[GT5X_GETRAWIMAGE] = 150000;
+    delays[GT5X_GETTEMPLATE] = 5000;
+    delays[GT5X_SETTEMPLATE] = 50000;
+    delays[GT5X_UPGRADEFIRMWARE] = 20000;
+    delays[GT5X_UPGRADEISOCDIMAGE] = 20000;
+
+    memset(&st, 0, sizeof(st));
+}
+
+void GT5XEmulator::begin(uint32_t baud) {
+    hbaud = baud;
+}
+
+/* ---------- host-facing Stream ---------- */
+
+int GT5XEmulator::available(void) {
+    uint64_t now = hostsim_now_us();
+    if (txq.empty() || txq.front().at > now)
+        return 0;
+
+    /* arrival times are monotonic, so binary search for the first byte still in flight */
+    TxByte key = {now, 0};
+    std::deque<TxByte>::iterator it = std::upper_bound(txq.begin(), txq.end(), key,
+        [](const TxByte & a, const TxByte & b) { return a.at < b.at; });
+
+    size_t n = it - txq.begin();
+    return n > 0x7fff ? 0x7fff : (int)n;
+}
+
+int GT5XEmulator::read(void) {
+    if (txq.empty() || txq.front().at > hostsim_now_us())
+        return -1;
+
+    uint8_t c = txq.front().val;
+    txq.pop_front();
+    return c;
+}
+
+int GT5XEmulator::peek(void) {
+    if (txq.empty() || txq.front().at > hostsim_now_us())
+        return -1;
+    return txq.front().val;
+}
+
+size_t GT5XEmulator::write(uint8_t c) {
+    double start = std::max((double)hostsim_now_us(), rx_free_at);
+    rx_free_at = start + byte_us(hbaud);
+
+    st.bytes_in++;
+    rx_byte(garble(c), (uint64_t)ceil(rx_free_at));
+    return 1;
+}
+
+size_t GT5XEmulator::write(const uint8_t * buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        write(buf[i]);
+    return len;
+}
+
+void GT5XEmulator::sleep_until_rx(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+    (void)port;
+    GT5XEmulator * emu = (GT5XEmulator *)ctx;
+
+    uint64_t now = hostsim_now_us();
+    uint64_t until = now + (uint64_t)(max_ms != 0 ? max_ms : 1) * 1000;
+    if (!emu->txq.empty() && emu->txq.front().at < until)
+        until = emu->txq.front().at;
+
+    hostsim_sleep_us(until > now ? until - now : 1);
+}
+
+/* ---------- module-side receive ---------- */
+
+void GT5XEmulator::rx_byte(uint8_t c, uint64_t at) {
+    if (rx_state == RX_HEADER) {
+        rx_header = (rx_header << 8) | c;
+
+        if (rx_header == (((uint16_t)GT5X_CMD_START_CODE1 << 8) | GT5X_CMD_START_CODE2)) {
+            rx_is_data = false;
+            rx_expect = 2 + GT5X_PARAM_CMD_LEN + 2;
+        }
+        else if (data_len != 0 && rx_header == (((uint16_t)GT5X_DATA_START_CODE1 << 8) | GT5X_DATA_START_CODE2)) {
+            rx_is_data = true;
+            rx_expect = 2 + data_len + 2;
+        }
+        else {
+            return;
+        }
+
+        rx_header = 0;
+        rx_buf.clear();
+        rx_state = RX_BODY;
+        return;
+    }
+
+    rx_buf.push_back(c);
+    if (rx_buf.size() < rx_expect)
+        return;
+
+    rx_state = RX_HEADER;
+
+    const uint8_t * pre = rx_is_data ? data_preamble : cmd_preamble;
+    uint16_t chksum = pre[0] + pre[1];
+    for (size_t i = 0; i < rx_buf.size() - 2; i++)
+        chksum += rx_buf[i];
+
+    uint16_t devid = rx_buf[0] | (rx_buf[1] << 8);
+    uint16_t rx_sum = rx_buf[rx_buf.size() - 2] | (rx_buf[rx_buf.size() - 1] << 8);
+
+    /* packets for other devices are ignored */
+    if (devid != GT5X_DEVICEID)
+        return;
+
+    if (chksum != rx_sum) {
+        st.bad_checksums++;
+        send_response(start_time(at), false, GT5X_NACK_COMM_ERR);
+        return;
+    }
+
+    if (rx_is_data) {
+        st.data_packets++;
+        handle_data(&rx_buf[2], data_len, at);
+    }
+    else {
+        st.commands++;
+        uint32_t param = read_le32(&rx_buf[2]);
+        uint16_t cmd = rx_buf[6] | (rx_buf[7] << 8);
+        handle_command(cmd, param, at);
+    }
+}
+
+uint64_t GT5XEmulator::start_time(uint64_t at) const {
+    return std::max(at, busy_until);
+}
+
+uint32_t GT5XEmulator::delay_for(uint8_t cmd, uint32_t param) const {
+    switch (cmd) {
+        /* delays[] for these covers the work done once the data has arrived */
+        case GT5X_VERIFYTEMPLATE1_1:
+        case GT5X_IDENTIFYTEMPLATE1_N:
+        case GT5X_SETTEMPLATE:
+        case GT5X_UPGRADEFIRMWARE:
+        case GT5X_UPGRADEISOCDIMAGE:
+            return EMU_ACK_DELAY_US;
+        case GT5X_CAPTUREFINGER:
+            return param != 0 ? delays[cmd] * 3 : delays[cmd];
+        case GT5X_IDENTIFY1_N:
+            return delays[cmd] + identify_cost_us * enrolled_count();
+        default:
+            return delays[cmd];
+    }
+}
+
+void GT5XEmulator::expect_data(uint8_t cmd, uint16_t len) {
+    data_cmd = cmd;
+    data_len = len;
+}
+
+void GT5XEmulator::handle_command(uint16_t cmd, uint32_t param, uint64_t at) {
+    uint64_t t = start_time(at);
+    apply_script(t);
+
+    t += delay_for((uint8_t)cmd, param);
+    busy_until = t;
+
+    /* a new command cancels any data phase left hanging */
+    data_len = 0;
+
+    switch (cmd) {
+        case GT5X_OPEN: {
+            send_response(t, true, 0);
+            if (param != 0) {
+                uint8_t info[sizeof(GT5X_DeviceInfo)];
+                uint32_t fw = EMU_FWVERSION, iso = EMU_ISO_MAX_SIZE;
+                memcpy(info, &fw, 4);
+                memcpy(info + 4, &iso, 4);
+                for (int i = 0; i < 16; i++)
+                    info[8 + i] = (uint8_t)(0xA0 + i);
+                send_data(t, info, sizeof(info));
+            }
+            break;
+        }
+        case GT5X_CLOSE:
+        case GT5X_SETIAPMODE:
+        case GT5X_GETDATABASESTART:
+        case GT5X_GETDATABASEEND:
+            send_response(t, true, 0);
+            break;
+        case GT5X_USBINTCHECK:
+            send_response(t, true, 0x55);
+            break;
+        case GT5X_CHANGEBAUDRATE:
+            switch (param) {
+                case 9600: case 19200: case 38400: case 57600: case 115200:
+                    send_response(t, true, 0);
+                    /* the ACK still goes out at the old rate */
+                    mbaud = param;
+                    break;
+                default:
+                    send_response(t, false, GT5X_NACK_INVALID_BAUDRATE);
+                    break;
+            }
+            break;
+        case GT5X_CMOSLED:
+            led = (param != 0);
+            send_response(t, true, 0);
+            break;
+        case GT5X_GETENROLLCNT:
+            send_response(t, true, enrolled_count());
+            break;
+        case GT5X_CHECKENROLLED:
+            if (param >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else if (!used[param])
+                send_response(t, false, GT5X_NACK_IS_NOT_USED);
+            else
+                send_response(t, true, 0);
+            break;
+        case GT5X_STARTENROLL:
+            if (param != 0xFFFFFFFF && param >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else if (param != 0xFFFFFFFF && used[param])
+                send_response(t, false, GT5X_NACK_IS_ALREADY_USED);
+            else if (param != 0xFFFFFFFF && enrolled_count() >= cap)
+                send_response(t, false, GT5X_NACK_DB_IS_FULL);
+            else {
+                enroll_id = (param == 0xFFFFFFFF) ? -1 : (int32_t)param;
+                enroll_pass = 1;
+                enroll_key = GT5X_EMU_NO_FINGER;
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_ENROLL1:
+        case GT5X_ENROLL2:
+        case GT5X_ENROLL3: {
+            uint8_t pass = cmd - GT5X_ENROLL1 + 1;
+            if (enroll_id == -2 || pass != enroll_pass) {
+                send_response(t, false, GT5X_NACK_TURN_ERR);
+                break;
+            }
+
+            int32_t key = captured;
+            captured = GT5X_EMU_NO_FINGER;
+
+            if (key == GT5X_EMU_NO_FINGER) {
+                enroll_id = -2;
+                send_response(t, false, GT5X_NACK_BAD_FINGER);
+                break;
+            }
+
+            if (pass == 1)
+                enroll_key = key;
+            else if (key != enroll_key) {
+                enroll_id = -2;
+                send_response(t, false, GT5X_NACK_ENROLL_FAILED);
+                break;
+            }
+
+            if (pass < 3) {
+                enroll_pass++;
+                send_response(t, true, 0);
+                break;
+            }
+
+            uint8_t tmpl[GT5X_TEMPLATESZ];
+            make_template(key, tmpl);
+
+            int32_t dup = search(tmpl);
+            int32_t fid = enroll_id;
+            enroll_id = -2;
+
+            if (dup >= 0) {
+                send_response(t, false, dup);
+                break;
+            }
+
+            send_response(t, true, 0);
+            if (fid == -1)
+                send_data(t, tmpl, GT5X_TEMPLATESZ);
+            else
+                store((uint16_t)fid, tmpl);
+
+            break;
+        }
+        case GT5X_ISPRESSFINGER:
+            send_response(t, true, finger_present() ? 0 : 1);
+            break;
+        case GT5X_DELETEID:
+            if (param >= cap || !used[param])
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else {
+                erase((uint16_t)param);
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_DELETEALL:
+            if (enrolled_count() == 0)
+                send_response(t, false, GT5X_NACK_DB_IS_EMPTY);
+            else {
+                erase_all();
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_VERIFY1_1: {
+            if (param >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else if (!used[param])
+                send_response(t, false, GT5X_NACK_IS_NOT_USED);
+            else if (captured == GT5X_EMU_NO_FINGER)
+                send_response(t, false, GT5X_NACK_FINGER_IS_NOT_PRESSED);
+            else {
+                uint8_t tmpl[GT5X_TEMPLATESZ];
+                make_template(captured, tmpl);
+                if (score(tmpl, template_at(param)) >= match_thresh)
+                    send_response(t, true, 0);
+                else
+                    send_response(t, false, GT5X_NACK_VERIFY_FAILED);
+            }
+            break;
+        }
+        case GT5X_IDENTIFY1_N: {
+            if (enrolled_count() == 0)
+                send_response(t, false, GT5X_NACK_DB_IS_EMPTY);
+            else if (captured == GT5X_EMU_NO_FINGER)
+                send_response(t, false, GT5X_NACK_FINGER_IS_NOT_PRESSED);
+            else {
+                uint8_t tmpl[GT5X_TEMPLATESZ];
+                make_template(captured, tmpl);
+                int32_t fid = search(tmpl);
+                if (fid >= 0)
+                    send_response(t, true, fid);
+                else
+                    send_response(t, false, GT5X_NACK_IDENTIFY_FAILED);
+            }
+            break;
+        }
+        case GT5X_VERIFYTEMPLATE1_1:
+            if (param >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else if (!used[param])
+                send_response(t, false, GT5X_NACK_IS_NOT_USED);
+            else {
+                data_param = param;
+                expect_data(cmd, GT5X_TEMPLATESZ);
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_IDENTIFYTEMPLATE1_N:
+            if (enrolled_count() == 0)
+                send_response(t, false, GT5X_NACK_DB_IS_EMPTY);
+            else {
+                expect_data(cmd, GT5X_TEMPLATESZ);
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_CAPTUREFINGER:
+            captured = capture(true);
+            if (captured == GT5X_EMU_NO_FINGER)
+                send_response(t, false, finger_present() ? GT5X_NACK_BAD_FINGER : GT5X_NACK_FINGER_IS_NOT_PRESSED);
+            else
+                send_response(t, true, 0);
+            break;
+        case GT5X_MAKETEMPLATE:
+            if (captured == GT5X_EMU_NO_FINGER)
+                send_response(t, false, GT5X_NACK_FINGER_IS_NOT_PRESSED);
+            else {
+                uint8_t tmpl[GT5X_TEMPLATESZ];
+                make_template(captured, tmpl);
+
+                /* a fresh capture never matches the stored copy byte for byte */
+                uint32_t s = (uint32_t)captured * 2654435761u + (uint32_t)at;
+                for (int i = 0; i < EMU_CAPTURE_NOISE; i++)
+                    tmpl[xorshift(&s) % GT5X_TEMPLATESZ] ^= 0xFF;
+
+                send_response(t, true, 0);
+                send_data(t, tmpl, GT5X_TEMPLATESZ);
+            }
+            break;
+        case GT5X_GETIMAGE: {
+            if (captured == GT5X_EMU_NO_FINGER) {
+                send_response(t, false, GT5X_NACK_FINGER_IS_NOT_PRESSED);
+                break;
+            }
+            std::vector<uint8_t> img(GT5X_EMU_FULLIMAGESZ);
+            make_image(captured, &img[0], 258, 202);
+            send_response(t, true, 0);
+            send_data(t, &img[0], img.size());
+            break;
+        }
+        case GT5X_GETRAWIMAGE: {
+            std::vector<uint8_t> img(GT5X_IMAGESZ);
+            make_image(capture(false), &img[0], GT5X_EMU_RAWIMAGE_W, GT5X_EMU_RAWIMAGE_H);
+            send_response(t, true, 0);
+            send_data(t, &img[0], img.size());
+            break;
+        }
+        case GT5X_GETTEMPLATE:
+            if (param >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else if (!used[param])
+                send_response(t, false, GT5X_NACK_IS_NOT_USED);
+            else {
+                send_response(t, true, 0);
+                send_data(t, template_at(param), GT5X_TEMPLATESZ);
+            }
+            break;
+        case GT5X_SETTEMPLATE:
+            if ((param & 0xffff) >= cap)
+                send_response(t, false, GT5X_NACK_INVALID_POS);
+            else {
+                data_param = param;
+                expect_data(cmd, GT5X_TEMPLATESZ);
+                send_response(t, true, 0);
+            }
+            break;
+        case GT5X_UPGRADEFIRMWARE:
+        case GT5X_UPGRADEISOCDIMAGE:
+            if (param == 0)
+                send_response(t, false, GT5X_NACK_INVALID_PARAM);
+            else {
+                upgrade_total = param;
+                upgrade_got = 0;
+                upgrade_sum = 0;
+                expect_data(cmd, std::min<uint32_t>(upgrade_chunk, param));
+                send_response(t, true, 0);
+            }
+            break;
+        default:
+            send_response(t, false, GT5X_NACK_IS_NOT_SUPPORTED);
+            break;
+    }
+}
+
+void GT5XEmulator::handle_data(const uint8_t * data, uint16_t len, uint64_t at) {
+    uint8_t cmd = data_cmd;
+    data_len = 0;
+
+    uint64_t t = start_time(at) + delays[cmd];
+    busy_until = t;
+
+    switch (cmd) {
+        case GT5X_SETTEMPLATE: {
+            uint16_t fid = data_param & 0xffff;
+            bool check_dup = (data_param & 0xff000000) == 0;
+
+            int32_t dup = check_dup ? search(data) : -1;
+            if (dup >= 0 && dup != fid) {
+                send_response(t, false, dup);
+                break;
+            }
+
+            store(fid, data);
+            send_response(t, true, 0);
+            break;
+        }
+        case GT5X_VERIFYTEMPLATE1_1:
+            if (score(data, template_at(data_param)) >= match_thresh)
+                send_response(t, true, 0);
+            else
+                send_response(t, false, GT5X_NACK_VERIFY_FAILED);
+            break;
+        case GT5X_IDENTIFYTEMPLATE1_N: {
+            t += identify_cost_us * enrolled_count();
+            busy_until = t;
+
+            int32_t fid = search(data);
+            if (fid >= 0)
+                send_response(t, true, fid);
+            else
+                send_response(t, false, GT5X_NACK_IDENTIFY_FAILED);
+            break;
+        }
+        case GT5X_UPGRADEFIRMWARE:
+        case GT5X_UPGRADEISOCDIMAGE: {
+            for (uint16_t i = 0; i < len; i++)
+                upgrade_sum += data[i];
+            upgrade_got += len;
+
+            send_response(t, true, upgrade_got);
+
+            uint32_t left = upgrade_total - upgrade_got;
+            if (left != 0)
+                expect_data(cmd, std::min<uint32_t>(upgrade_chunk, left));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/* ---------- module-side transmit ---------- */
+
+void GT5XEmulator::send_response(uint64_t at, bool ack, uint32_t param) {
+    uint8_t body[GT5X_PARAM_CMD_LEN];
+    uint16_t rcode = ack ? GT5X_ACK : GT5X_NACK;
+
+    memcpy(body, &param, 4);
+    memcpy(body + 4, &rcode, 2);
+    send_packet(at, cmd_preamble, body, sizeof(body));
+}
+
+void GT5XEmulator::send_data(uint64_t at, const uint8_t * data, uint32_t len) {
+    send_packet(at, data_preamble, data, len);
+}
+
+void GT5XEmulator::send_packet(uint64_t at, const uint8_t * preamble, const uint8_t * body, uint32_t len) {
+    uint16_t chksum = 0;
+    for (int i = 0; i < 4; i++)
+        chksum += preamble[i];
+    for (uint32_t i = 0; i < len; i++)
+        chksum += body[i];
+
+    bool eligible = !corrupt_data_only || preamble == data_preamble;
+    if (eligible && corrupt_rate > 0 && rand01() < corrupt_rate) {
+        chksum ^= 0x0100;
+        st.corrupted++;
+    }
+
+    double t = std::max((double)at, tx_free_at);
+    double bt = byte_us(mbaud);
+    uint32_t total = 4 + len + 2;
+
+    for (uint32_t i = 0; i < total; i++) {
+        uint8_t c;
+        if (i < 4)
+            c = preamble[i];
+        else if (i < 4 + len)
+            c = body[i - 4];
+        else
+            c = (i == total - 2) ? (uint8_t)chksum : (uint8_t)(chksum >> 8);
+
+        t += bt;
+
+        if (drop_rate > 0 && rand01() < drop_rate) {
+            st.dropped++;
+            continue;
+        }
+
+        TxByte b = {(uint64_t)ceil(t), garble(c)};
+        txq.push_back(b);
+        st.bytes_out++;
+    }
+
+    tx_free_at = t;
+}
+
+/* ---------- finger and database model ---------- */
+
+void GT5XEmulator::place_finger(int32_t key, bool good) {
+    finger_key = key;
+    finger_good = good;
+}
+
+void GT5XEmulator::lift_finger(void) {
+    finger_key = GT5X_EMU_NO_FINGER;
+}
+
+void GT5XEmulator::script_finger(uint64_t at_us, int32_t key, bool good) {
+    FingerEvent ev = {at_us, key, good};
+
+    std::deque<FingerEvent>::iterator it = script.begin();
+    while (it != script.end() && it->at <= at_us)
+        ++it;
+    script.insert(it, ev);
+}
+
+void GT5XEmulator::apply_script(uint64_t at) {
+    while (!script.empty() && script.front().at <= at) {
+        finger_key = script.front().key;
+        finger_good = script.front().good;
+        script.pop_front();
+    }
+}
+
+int32_t GT5XEmulator::capture(bool need_good) {
+    if (finger_key == GT5X_EMU_NO_FINGER)
+        return GT5X_EMU_NO_FINGER;
+    if (need_good && !finger_good)
+        return GT5X_EMU_NO_FINGER;
+    return finger_key;
+}
+
+uint16_t GT5XEmulator::enrolled_count(void) const {
+    return (uint16_t)std::count(used.begin(), used.end(), true);
+}
+
+bool GT5XEmulator::store(uint16_t fid, const uint8_t * tmpl) {
+    if (fid >= cap)
+        return false;
+
+    memcpy(&db[(size_t)fid * GT5X_TEMPLATESZ], tmpl, GT5X_TEMPLATESZ);
+    used[fid] = true;
+    return true;
+}
+
+bool GT5XEmulator::store_finger(uint16_t fid, int32_t key) {
+    uint8_t tmpl[GT5X_TEMPLATESZ];
+    make_template(key, tmpl);
+    return store(fid, tmpl);
+}
+
+bool GT5XEmulator::erase(uint16_t fid) {
+    if (fid >= cap || !used[fid])
+        return false;
+    used[fid] = false;
+    return true;
+}
+
+void GT5XEmulator::erase_all(void) {
+    std::fill(used.begin(), used.end(), false);
+}
+
+const uint8_t * GT5XEmulator::template_at(uint16_t fid) const {
+    return (fid < cap && used[fid]) ? &db[(size_t)fid * GT5X_TEMPLATESZ] : NULL;
+}
+
+void GT5XEmulator::make_template(int32_t key, uint8_t * out) {
+    uint32_t s = (uint32_t)key * 2654435761u + 0x9E3779B9u;
+    if (s == 0)
+        s = 1;
+
+    for (int i = 0; i < GT5X_TEMPLATESZ; i++)
+        out[i] = (uint8_t)xorshift(&s);
+}
+
+uint16_t GT5XEmulator::score(const uint8_t * a, const uint8_t * b) {
+    uint16_t same = 0;
+    for (int i = 0; i < GT5X_TEMPLATESZ; i++)
+        same += (a[i] == b[i]);
+    return same;
+}
+
+int32_t GT5XEmulator::search(const uint8_t * tmpl) const {
+    for (uint16_t fid = 0; fid < cap; fid++) {
+        if (used[fid] && score(tmpl, template_at(fid)) >= match_thresh)
+            return fid;
+    }
+    return -1;
+}
+
+/* concentric ridges centred on a key-dependent core, flat background elsewhere */
+void GT5XEmulator::make_image(int32_t key, uint8_t * out, uint16_t w, uint16_t h) const {
+    if (key == GT5X_EMU_NO_FINGER) {
+        memset(out, EMU_BG_PIXEL, (size_t)w * h);
+        return;
+    }
+
+    uint32_t s = (uint32_t)key * 2654435761u + 1;
+    double cx = w * (0.35 + 0.3 * (xorshift(&s) % 100) / 100.0);
+    double cy = h * (0.35 + 0.3 * (xorshift(&s) % 100) / 100.0);
+    double period = 4.0 + (xorshift(&s) % 3);
+    double rx = w * 0.38, ry = h * 0.45;
+
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            double dx = (x - w / 2.0) / rx, dy = (y - h / 2.0) / ry;
+            if (dx * dx + dy * dy > 1.0) {
+                out[(size_t)y * w + x] = EMU_BG_PIXEL;
+                continue;
+            }
+            double r = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy) * 1.3);
+            out[(size_t)y * w + x] = (uint8_t)(128 + 100 * sin(2 * M_PI * r / period));
+        }
+    }
+}
+
+double GT5XEmulator::rand01(void) {
+    return (xorshift(&rng) >> 8) / 16777216.0;
+}
+
+void GT5XEmulator::reset_stats(void) {
+    memset(&st, 0, sizeof(st));
+}
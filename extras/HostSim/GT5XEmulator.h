@@ -0,0 +1,188 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* In-process GT-521Fxx emulator. It is the Stream handed to GT5X, so whatever
+ * the driver writes is parsed as if it arrived over the module's UART and the
+ * replies only become readable once the (virtual) clock has moved past their
+ * transmission time at the configured baud rate. */
+
+#ifndef GT5X_EMULATOR_H
+#define GT5X_EMULATOR_H
+
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "GT5X.h"
+
+/* GetImage (0x62) returns the full 258 x 202 frame */
+#define GT5X_EMU_FULLIMAGESZ        (258UL * 202UL)
+
+#define GT5X_EMU_RAWIMAGE_W         160
+#define GT5X_EMU_RAWIMAGE_H         120
+
+#define GT5X_EMU_NO_FINGER          (-1)
+
+class GT5XEmulator : public Stream {
+    public:
+        struct Stats {
+            uint32_t commands;          /* command packets accepted */
+            uint32_t data_packets;      /* data packets accepted from the host */
+            uint32_t bad_checksums;     /* host packets with a wrong checksum */
+            uint32_t bytes_in;
+            uint32_t bytes_out;
+            uint32_t dropped;           /* response bytes thrown away */
+            uint32_t corrupted;         /* responses sent with a bad checksum */
+        };
+
+        /* 3000 slots for a GT-521F52, 200 for a GT-521F32/GT-511C3 */
+        GT5XEmulator(uint16_t capacity = 3000, uint32_t baud = 9600);
+
+        /* host side of the link; the module keeps its own rate */
+        void begin(uint32_t baud);
+        uint32_t host_baud(void) const { return hbaud; }
+        uint32_t module_baud(void) const { return mbaud; }
+
+        int available(void);
+        int read(void);
+        int peek(void);
+        size_t write(uint8_t c);
+        size_t write(const uint8_t * buf, size_t len);
+        using Print::write;
+
+        /* fault injection, probabilities in [0, 1] */
+        void set_drop_rate(double rate) { drop_rate = rate; }
+        void set_corrupt_rate(double rate, bool data_only = false) { corrupt_rate = rate; corrupt_data_only = data_only; }
+        void set_seed(uint32_t seed) { rng = seed ? seed : 1; }
+
+        /* a GT5X_WaitHook standing in for sleeping until the UART interrupt: the clock 
+           jumps to the next byte's arrival, or max_ms on if none is due sooner. Use as
+           finger.set_wait_hook(GT5XEmulator::sleep_until_rx, &emu) */
+        static void sleep_until_rx(GT5X_Transport * port, uint32_t max_ms, void * ctx);
+
+        /* module-side processing time before a command is answered */
+        void set_processing_delay(uint8_t cmd, uint32_t us) { delays[cmd] = us; }
+        void set_identify_cost_us(uint32_t us) { identify_cost_us = us; }
+
+        /* finger scripting: a key identifies a "person", quality decides
+           whether capture and enrollment succeed */
+        void place_finger(int32_t key, bool good = true);
+        void lift_finger(void);
+        void script_finger(uint64_t at_us, int32_t key, bool good = true);
+        bool finger_present(void) const { return finger_key != GT5X_EMU_NO_FINGER; }
+        bool led_on(void) const { return led; }
+
+        /* direct database access */
+        uint16_t capacity(void) const { return cap; }
+        uint16_t enrolled_count(void) const;
+        bool is_used(uint16_t fid) const { return fid < cap && used[fid]; }
+        bool store(uint16_t fid, const uint8_t * tmpl);
+        bool store_finger(uint16_t fid, int32_t key);
+        bool erase(uint16_t fid);
+        void erase_all(void);
+        const uint8_t * template_at(uint16_t fid) const;
+
+        /* match threshold, in equal bytes out of GT5X_TEMPLATESZ */
+        void set_match_threshold(uint16_t thresh) { match_thresh = thresh; }
+        static void make_template(int32_t key, uint8_t * out);
+        static uint16_t score(const uint8_t * a, const uint8_t * b);
+
+        uint32_t upgrade_received(void) const { return upgrade_got; }
+        uint32_t upgrade_checksum(void) const { return upgrade_sum; }
+
+        const Stats & stats(void) const { return st; }
+        void reset_stats(void);
+
+    private:
+        enum RxState {
+            RX_HEADER,
+            RX_BODY
+        };
+
+        struct TxByte {
+            uint64_t at;
+            uint8_t val;
+        };
+
+        struct FingerEvent {
+            uint64_t at;
+            int32_t key;
+            bool good;
+        };
+
+        void rx_byte(uint8_t c, uint64_t at);
+        void handle_command(uint16_t cmd, uint32_t param, uint64_t at);
+        void handle_data(const uint8_t * data, uint16_t len, uint64_t at);
+
+        void send_response(uint64_t at, bool ack, uint32_t param);
+        void send_data(uint64_t at, const uint8_t * data, uint32_t len);
+        void send_packet(uint64_t at, const uint8_t * preamble, const uint8_t * body, uint32_t len);
+        void expect_data(uint8_t cmd, uint16_t len);
+
+        uint64_t start_time(uint64_t at) const;
+        uint32_t delay_for(uint8_t cmd, uint32_t param) const;
+        double byte_us(uint32_t baud) const { return 10.0e6 / baud; }
+        uint8_t garble(uint8_t c) const { return hbaud == mbaud ? c : (uint8_t)(c ^ 0xA7); }
+
+        void apply_script(uint64_t at);
+        int32_t capture(bool need_good);
+        int32_t search(const uint8_t * tmpl) const;
+        void make_image(int32_t key, uint8_t * out, uint16_t w, uint16_t h) const;
+
+        double rand01(void);
+
+        uint16_t cap;
+        uint32_t hbaud;
+        uint32_t mbaud;
+
+        /* module -> host */
+        std::deque<TxByte> txq;
+        double tx_free_at;
+
+        /* host -> module */
+        double rx_free_at;
+        RxState rx_state;
+        std::vector<uint8_t> rx_buf;
+        uint16_t rx_header;
+        uint16_t rx_expect;
+        bool rx_is_data;
+
+        /* data phase the module is waiting on, after an ACK */
+        uint8_t data_cmd;
+        uint16_t data_len;
+        uint32_t data_param;
+
+        uint64_t busy_until;
+        uint32_t delays[256];
+        uint32_t identify_cost_us;
+
+        std::vector<bool> used;
+        std::vector<uint8_t> db;
+        uint16_t match_thresh;
+
+        int32_t finger_key;
+        bool finger_good;
+        std::deque<FingerEvent> script;
+
+        bool led;
+        int32_t captured;
+
+        /* -2: idle, -1: enroll without saving, else target slot */
+        int32_t enroll_id;
+        uint8_t enroll_pass;
+        int32_t enroll_key;
+
+        uint32_t upgrade_total;
+        uint32_t upgrade_got;
+        uint32_t upgrade_sum;
+        uint16_t upgrade_chunk;
+
+        double drop_rate;
+        double corrupt_rate;
+        bool corrupt_data_only;
+        uint32_t rng;
+
+        Stats st;
+};
+
+#endif
@@ -0,0 +1,33 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* GT5X_Source over a stdio FILE, for feeding firmware images and backups
+ * to the driver from the host's filesystem */
+
+#ifndef GT5X_FILE_SOURCE_H
+#define GT5X_FILE_SOURCE_H
+
+#include <stdio.h>
+#include "GT5X.h"
+
+class GT5X_FileSource : public GT5X_Source {
+    public:
+        GT5X_FileSource(FILE * f) : file(f) {}
+        uint16_t read(uint8_t * buf, uint16_t len) { return (uint16_t)fread(buf, 1, len, file); }
+
+        /* bytes from here to the end, i.e. the size to give GT5X_Upgrader::start() */
+        uint32_t remaining(void) {
+            long pos = ftell(file);
+            if (pos < 0 || fseek(file, 0, SEEK_END) != 0)
+                return 0;
+
+            long end = ftell(file);
+            fseek(file, pos, SEEK_SET);
+            return end > pos ? (uint32_t)(end - pos) : 0;
+        }
+
+    private:
+        FILE * file;
+};
+
+#endif
@@ -0,0 +1,369 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+/* Round-trip and transfer benchmarks for GT5X against the emulator.
+ *
+ * Latencies are in virtual time (what the link and module would cost on real
+ * hardware); host_ns and cycles are what the driver itself burned on this CPU
+ * while waiting, and polls is the number of yield() calls made by the
+ * response loops. cpu_us is the part of the latency the sensor's host core
+ * spent awake rather than asleep in the wait hook, host_cpu_ns the CPU time
+ * this thread actually used. Results are printed as one JSON document on stdout.
+ *
+ * usage: bench [-n iters] [-b baud] [-d drop_rate] [-c corrupt_rate] [-s db_size] [-a 1]
+ *              [-w busy|yield|sleep]
+ *
+ * -w picks the wait hook: spinning, yield() (the default) or sleeping until
+ * the next byte arrives, as GT5X_wait_sleep does with the UART interrupt.
+ *
+ * -a 1 turns on adaptive timeouts, which mostly shows in how long failed
+ * exchanges take to be given up on when bytes are being dropped.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BENCH_CYCLES()      __rdtsc()
+#else
+    #define BENCH_CYCLES()      0ULL
+#endif
+
+#include "Arduino.h"
+#include "GT5X.h"
+#include "GT5XEmulator.h"
+#include "GT5XFileSource.h"
+#include "GT5XUpgrade.h"
+
+/* long enough for any reply still in flight after a failed exchange */
+#define DRAIN_MS        3000
+
+/* firmware image for the upgrade cases, read from a temporary file
+   at about the rate of FAT on an SD card over SPI */
+#define UPGRADE_IMAGESZ     65536
+#define SOURCE_US_PER_KB    4000
+
+/* stands in for Serial/SD when benchmarking GT5X_OUTPUT_TO_STREAM */
+class NullStream : public Stream {
+    public:
+        NullStream() : count(0) {}
+        int available(void) { return 0; }
+        int read(void) { return -1; }
+        int peek(void) { return -1; }
+        size_t write(uint8_t c) { (void)c; count++; return 1; }
+        size_t write(const uint8_t * buf, size_t len) { (void)buf; count += len; return len; }
+        using Print::write;
+
+        uint32_t count;
+};
+
+/* digest accumulator, the kind of sink that never needs a buffer of its own */
+class HashSink : public GT5X_Sink {
+    public:
+        HashSink() : hash(2166136261u) {}
+        bool write(const uint8_t * data, uint16_t len) {
+            for (uint16_t i = 0; i < len; i++)
+                hash = (hash ^ data[i]) * 16777619u;
+            return true;
+        }
+
+        uint32_t hash;
+};
+
+/* file source that takes as long as the card would */
+class SlowFileSource : public GT5X_FileSource {
+    public:
+        SlowFileSource(FILE * f) : GT5X_FileSource(f) {}
+        uint16_t read(uint8_t * buf, uint16_t len) {
+            uint16_t n = GT5X_FileSource::read(buf, len);
+            hostsim_advance_us((uint64_t)n * SOURCE_US_PER_KB / 1024);
+            return n;
+        }
+};
+
+struct Sample {
+    uint64_t virt_us;
+    uint64_t cpu_us;
+    uint64_t host_ns;
+    uint64_t host_cpu_ns;
+    uint64_t cycles;
+    uint64_t polls;
+    bool ok;
+};
+
+struct Result {
+    std::string name;
+    uint32_t baud;
+    uint32_t payload;
+    std::vector<Sample> samples;
+};
+
+typedef bool (*BenchFn)(GT5X & finger, GT5XEmulator & emu);
+
+static uint8_t bigbuf[GT5X_IMAGESZ];
+static NullStream sink;
+static FILE * upgrade_file;
+static uint8_t upgrade_work[2 * GT5X_UPGRADE_CHUNKSZ];
+
+static bool bench_set_led(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.set_led(true) == GT5X_OK;
+}
+
+static bool bench_is_pressed(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.is_pressed();
+}
+
+static bool bench_capture(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.capture_finger() == GT5X_OK;
+}
+
+static bool bench_search(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    uint16_t fid;
+    return finger.capture_finger() == GT5X_OK && finger.search_database(&fid) == GT5X_OK;
+}
+
+static bool bench_template_buf(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.get_template(0) == GT5X_OK
+        && finger.read_raw(GT5X_OUTPUT_TO_BUFFER, bigbuf, GT5X_TEMPLATESZ);
+}
+
+static bool bench_template_stream(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.get_template(0) == GT5X_OK
+        && finger.read_raw(GT5X_OUTPUT_TO_STREAM, &sink, GT5X_TEMPLATESZ);
+}
+
+static bool bench_image_buf(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.get_image() == GT5X_OK
+        && finger.read_raw(GT5X_OUTPUT_TO_BUFFER, bigbuf, GT5X_IMAGESZ);
+}
+
+static bool bench_image_stream(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return finger.get_image() == GT5X_OK
+        && finger.read_raw(GT5X_OUTPUT_TO_STREAM, &sink, GT5X_IMAGESZ);
+}
+
+static bool bench_image_hash(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    HashSink hs;
+    return finger.get_image() == GT5X_OK
+        && finger.read_raw(&hs, GT5X_IMAGESZ);
+}
+
+static bool bench_upgrade(GT5X & finger, uint16_t work_size) {
+    rewind(upgrade_file);
+    SlowFileSource src(upgrade_file);
+    GT5X_Upgrader up(&finger, upgrade_work, work_size);
+    return up.upgrade(GT5X_UPGRADEFIRMWARE, &src, UPGRADE_IMAGESZ) == GT5X_OK;
+}
+
+/* each chunk read only once the last is ACKed */
+static bool bench_upgrade_1buf(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return bench_upgrade(finger, GT5X_UPGRADE_CHUNKSZ);
+}
+
+/* the next chunk read while the module writes the last */
+static bool bench_upgrade_2buf(GT5X & finger, GT5XEmulator & emu) {
+    (void)emu;
+    return bench_upgrade(finger, sizeof(upgrade_work));
+}
+
+static const struct {
+    const char * name;
+    BenchFn fn;
+    uint32_t payload;
+} benches[] = {
+    {"set_led",                 bench_set_led,          0},
+    {"is_pressed",              bench_is_pressed,       0},
+    {"capture_finger",          bench_capture,          0},
+    {"search_database",         bench_search,           0},
+    {"get_template_buffer",     bench_template_buf,     GT5X_TEMPLATESZ},
+    {"get_template_stream",     bench_template_stream,  GT5X_TEMPLATESZ},
+    {"get_image_buffer",        bench_image_buf,        GT5X_IMAGESZ},
+    {"get_image_stream",        bench_image_stream,     GT5X_IMAGESZ},
+    {"get_image_hash_sink",     bench_image_hash,       GT5X_IMAGESZ},
+    {"upgrade_firmware_1buf",   bench_upgrade_1buf,     UPGRADE_IMAGESZ},
+    {"upgrade_firmware_2buf",   bench_upgrade_2buf,     UPGRADE_IMAGESZ},
+};
+
+static uint64_t host_now_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* GT5X_wait_busy would never move the virtual clock; this spins at the cost 
+   of one poll without counting as a yield() */
+static void wait_spin(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+    (void)port;
+    (void)max_ms;
+    (void)ctx;
+    hostsim_advance_us(1);
+}
+
+static uint64_t percentile(std::vector<uint64_t> v, double p) {
+    if (v.empty())
+        return 0;
+    std::sort(v.begin(), v.end());
+    size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[idx];
+}
+
+static void print_result(const Result & r, bool last) {
+    std::vector<uint64_t> virt, cpu, host, host_cpu, cyc, polls;
+    uint32_t ok = 0;
+    uint64_t virt_ok = 0;
+
+    for (size_t i = 0; i < r.samples.size(); i++) {
+        const Sample & s = r.samples[i];
+        virt.push_back(s.virt_us);
+        cpu.push_back(s.cpu_us);
+        host.push_back(s.host_ns);
+        host_cpu.push_back(s.host_cpu_ns);
+        cyc.push_back(s.cycles);
+        polls.push_back(s.polls);
+        if (s.ok) {
+            ok++;
+            virt_ok += s.virt_us;
+        }
+    }
+
+    double bps = (r.payload && virt_ok) ? (double)r.payload * ok * 1e6 / virt_ok : 0;
+
+    printf("    {\"name\": \"%s\", \"baud\": %u, \"iters\": %u, \"ok\": %u, \"payload\": %u,\n",
+           r.name.c_str(), r.baud, (unsigned)r.samples.size(), ok, r.payload);
+    printf("     \"latency_us\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu},\n",
+           (unsigned long long)percentile(virt, 0.5), (unsigned long long)percentile(virt, 0.9),
+           (unsigned long long)percentile(virt, 0.99), (unsigned long long)percentile(virt, 1.0));
+    printf("     \"cpu_us\": {\"p50\": %llu, \"p99\": %llu}, \"host_cpu_ns_p50\": %llu,\n",
+           (unsigned long long)percentile(cpu, 0.5), (unsigned long long)percentile(cpu, 0.99),
+           (unsigned long long)percentile(host_cpu, 0.5));
+    printf("     \"host_ns\": {\"p50\": %llu, \"p99\": %llu}, \"cycles_p50\": %llu, \"polls_p50\": %llu,\n",
+           (unsigned long long)percentile(host, 0.5), (unsigned long long)percentile(host, 0.99),
+           (unsigned long long)percentile(cyc, 0.5), (unsigned long long)percentile(polls, 0.5));
+    printf("     \"bytes_per_sec\": %.1f}%s\n", bps, last ? "" : ",");
+}
+
+int main(int argc, char ** argv) {
+    uint32_t iters = 20;
+    uint32_t only_baud = 0;
+    double drop = 0, corrupt = 0;
+    uint16_t db_size = 200;
+    bool adaptive = false;
+    std::string wait = "yield";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string opt = argv[i];
+        if (opt == "-n") iters = atoi(argv[i + 1]);
+        else if (opt == "-b") only_baud = atoi(argv[i + 1]);
+        else if (opt == "-d") drop = atof(argv[i + 1]);
+        else if (opt == "-c") corrupt = atof(argv[i + 1]);
+        else if (opt == "-s") db_size = atoi(argv[i + 1]);
+        else if (opt == "-a") adaptive = atoi(argv[i + 1]) != 0;
+        else if (opt == "-w") wait = argv[i + 1];
+        else {
+            wait.clear();
+            break;
+        }
+    }
+
+    if (wait != "busy" && wait != "yield" && wait != "sleep") {
+        fprintf(stderr, "usage: %s [-n iters] [-b baud] [-d drop] [-c corrupt] [-s db_size] [-a 1] "
+                        "[-w busy|yield|sleep]\n", argv[0]);
+        return 1;
+    }
+
+    upgrade_file = tmpfile();
+    if (upgrade_file == NULL) {
+        perror("tmpfile");
+        return 1;
+    }
+    for (uint32_t i = 0; i < UPGRADE_IMAGESZ; i++)
+        fputc((uint8_t)(i * 7 + (i >> 9)), upgrade_file);
+
+    static const uint32_t bauds[] = {9600, 19200, 38400, 57600, 115200};
+    std::vector<Result> results;
+
+    for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        if (only_baud && bauds[b] != only_baud)
+            continue;
+
+        GT5XEmulator emu(3000, bauds[b]);
+        GT5X finger(&emu);
+
+        if (!finger.begin()) {
+            fprintf(stderr, "begin() failed at %u baud\n", bauds[b]);
+            return 1;
+        }
+        finger.set_adaptive_timeouts(adaptive);
+        if (wait == "busy")
+            finger.set_wait_hook(wait_spin);
+        else if (wait == "sleep")
+            finger.set_wait_hook(GT5XEmulator::sleep_until_rx, &emu);
+
+        for (uint16_t fid = 0; fid < db_size; fid++)
+            emu.store_finger(fid, 1000 + fid);
+        emu.place_finger(1000 + db_size - 1);
+
+        emu.set_drop_rate(drop);
+        emu.set_corrupt_rate(corrupt);
+
+        for (size_t n = 0; n < sizeof(benches) / sizeof(benches[0]); n++) {
+            Result r;
+            r.name = benches[n].name;
+            r.baud = bauds[b];
+            r.payload = benches[n].payload;
+
+            for (uint32_t i = 0; i < iters; i++) {
+                Sample s;
+                uint64_t v0 = hostsim_now_us(), p0 = hostsim_yield_count(), z0 = hostsim_slept_us();
+                uint64_t h0 = host_now_ns(), t0 = thread_cpu_ns(), c0 = BENCH_CYCLES();
+
+                s.ok = benches[n].fn(finger, emu);
+
+                s.cycles = BENCH_CYCLES() - c0;
+                s.host_cpu_ns = thread_cpu_ns() - t0;
+                s.host_ns = host_now_ns() - h0;
+                s.polls = hostsim_yield_count() - p0;
+                s.virt_us = hostsim_now_us() - v0;
+                s.cpu_us = s.virt_us - (hostsim_slept_us() - z0);
+                r.samples.push_back(s);
+
+                /* let anything left over from a failed exchange drain */
+                if (!s.ok) {
+                    delay(DRAIN_MS);
+                    while (emu.read() >= 0);
+                }
+            }
+
+            results.push_back(r);
+        }
+    }
+
+    printf("{\n  \"version\": 1,\n  \"iters\": %u, \"db_size\": %u, \"drop_rate\": %g, \"corrupt_rate\": %g, \"adaptive\": %s, \"wait\": \"%s\",\n",
+           iters, db_size, drop, corrupt, adaptive ? "true" : "false", wait.c_str());
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+        print_result(results[i], i + 1 == results.size());
+    printf("  ]\n}\n");
+
+    return 0;
+}
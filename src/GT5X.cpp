@@ -3,377 +3,1339 @@
  
 #include <Arduino.h>
 #include "GT5X.h"
+#include "GT5XCache.h"
 
-#if defined(GT5X_ENABLE_DEBUG)
-    #define GT5X_DEFAULT_STREAM          Serial
-
-    #define GT5X_DEBUG_PRINT(x)          GT5X_DEFAULT_STREAM.print(x)
-    #define GT5X_DEBUG_PRINTLN(x)        GT5X_DEFAULT_STREAM.println(x)
-    #define GT5X_DEBUG_DEC(x)            GT5X_DEFAULT_STREAM.print(x)
-    #define GT5X_DEBUG_DECLN(x)          GT5X_DEFAULT_STREAM.println(x)
-    #define GT5X_DEBUG_HEX(x)            GT5X_DEFAULT_STREAM.print(x, HEX)
-    #define GT5X_DEBUG_HEXLN(x)          GT5X_DEFAULT_STREAM.println(x, HEX) 
+#if defined(__AVR__)
+    #include <avr/sleep.h>
+#endif
+
+#if defined(GT5X_ENABLE_METRICS)
+    #include "GT5XMetrics.h"
+    #define GT5X_METRIC(x)              do { if (metrics != NULL) { metrics->x; } } while (0)
+#else
+    #define GT5X_METRIC(x)
+#endif
+
+#if defined(GT5X_ENABLE_TRACE)
+    #define GT5X_TRACE(ev, a, b)        do { if (trace_hook != NULL) trace_hook(this, (ev), (a), (b), trace_ctx); } while (0)
 #else
-    #define GT5X_DEBUG_PRINT(x)
-    #define GT5X_DEBUG_PRINTLN(x)
-    #define GT5X_DEBUG_DEC(x)          
-    #define GT5X_DEBUG_DECLN(x)
-    #define GT5X_DEBUG_HEX(x)
-    #define GT5X_DEBUG_HEXLN(x)
+    #define GT5X_TRACE(ev, a, b)
 #endif
 
 typedef enum {
     GT5X_STATE_READ_HEADER,
     GT5X_STATE_READ_DEVID,
-    GT5X_STATE_READ_PARAMS,
-    GT5X_STATE_READ_RESPONSE,
     GT5X_STATE_READ_DATA,
-    GT5X_STATE_READ_CHECKSUM
+    GT5X_STATE_READ_CHECKSUM,
+    GT5X_STATE_DONE,
+    GT5X_STATE_BAD_CHECKSUM,
+    GT5X_STATE_ABORTED
 } GT5X_State;
 
-void GT5X::write_cmd_packet(uint16_t cmd, uint32_t params) {   
-    uint8_t preamble[] = {GT5X_CMD_START_CODE1, GT5X_CMD_START_CODE2, 
-                          (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+typedef enum {
+    GT5X_PIPE_IDLE,
+    GT5X_PIPE_LED_ON,
+    GT5X_PIPE_WAIT,
+    GT5X_PIPE_PRESENCE,
+    GT5X_PIPE_CAPTURE,
+    GT5X_PIPE_IDENTIFY,
+    GT5X_PIPE_LED_OFF,
+    GT5X_PIPE_SEND_TEMPLATE,
+    GT5X_PIPE_MATCH_TEMPLATE
+} GT5X_PipeStage;
+
+/* ---------- built-in sinks ---------- */
+
+GT5X_BufferSink::GT5X_BufferSink(uint8_t * buf, uint16_t len) {
+    reset(buf, len);
+}
+
+void GT5X_BufferSink::reset(uint8_t * buf, uint16_t len) {
+    base = buf;
+    pos = buf;
+    end = buf + len;
+}
+
+bool GT5X_BufferSink::write(const uint8_t * data, uint16_t len) {
+    if (len > (uint16_t)(end - pos))
+        return false;
+    
+    /* nothing to copy if the parser read straight into our memory */
+    if (data != pos)
+        memcpy(pos, data, len);
+    
+    pos += len;
+    return true;
+}
+
+uint8_t * GT5X_BufferSink::acquire(uint16_t * len) {
+    *len = end - pos;
+    return pos;
+}
+
+void GT5X_BufferSink::rewind(void) {
+    pos = base;
+}
+
+GT5X_StreamSink::GT5X_StreamSink(Stream * s) : stream(s) 
+{
+    
+}
+
+bool GT5X_StreamSink::write(const uint8_t * data, uint16_t len) {
+    return stream->write(data, len) == len;
+}
+
+/* ---------- built-in sources ---------- */
+
+bool GT5X_Source::read_fully(uint8_t * buf, uint16_t len) {
+    while (len != 0) {
+        uint16_t got = read(buf, len);
+        if (got == 0)
+            return false;
+        
+        buf += got;
+        len -= got;
+    }
+    
+    return true;
+}
+
+GT5X_BufferSource::GT5X_BufferSource(const uint8_t * buf, uint32_t len) : pos(buf), left(len)
+{
+    
+}
+
+uint16_t GT5X_BufferSource::read(uint8_t * buf, uint16_t len) {
+    if (len > left)
+        len = left;
+    
+    memcpy(buf, pos, len);
+    pos += len;
+    left -= len;
+    return len;
+}
+
+GT5X_StreamSource::GT5X_StreamSource(Stream * s) : stream(s)
+{
     
-    uint16_t chksum = 0;
-    for (int i = 0; i < sizeof(preamble); i++) {
-        chksum += preamble[i];
+}
+
+uint16_t GT5X_StreamSource::read(uint8_t * buf, uint16_t len) {
+    return stream->readBytes(buf, len);
+}
+
+/* ---------- transports ---------- */
+
+void GT5X_Transport::discard(void) {
+    uint8_t scratch[8];
+    while (read(scratch, sizeof(scratch)) != 0);
+}
+
+GT5X_StreamTransport::GT5X_StreamTransport(Stream * s) : stream(s)
+{
+    
+}
+
+uint16_t GT5X_StreamTransport::available(void) {
+    int avail = stream->available();
+    return (avail > 0) ? avail : 0;
+}
+
+uint16_t GT5X_StreamTransport::read(uint8_t * buf, uint16_t len) {
+    uint16_t avail = available();
+    if (len > avail)
+        len = avail;
+    
+    /* the bytes are already there, so skip readBytes() and its timer check per byte */
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = stream->read();
     }
+    return len;
+}
+
+void GT5X_StreamTransport::write(const uint8_t * data, uint16_t len) {
+    stream->write(data, len);
+}
+
+static const uint8_t cmd_preamble[GT5X_PREAMBLE_LEN] = {GT5X_CMD_START_CODE1, GT5X_CMD_START_CODE2, 
+                                                        (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+static const uint8_t data_preamble[GT5X_PREAMBLE_LEN] = {GT5X_DATA_START_CODE1, GT5X_DATA_START_CODE2, 
+                                                         (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+
+/* the whole 12-byte frame goes out in one write, so a USB-CDC or 
+   buffered port doesn't turn it into three transfers */
+void GT5X::write_cmd_packet(uint16_t cmd, uint32_t params) {   
+    uint8_t * body = buffer + GT5X_PREAMBLE_LEN;
+    uint16_t chksum = GT5X_CMD_PREAMBLE_SUM;
     
-    memcpy(buffer, &params, sizeof(params));
-    memcpy(buffer + sizeof(params), &cmd, sizeof(cmd));
+    memcpy(buffer, cmd_preamble, GT5X_PREAMBLE_LEN);
+    memcpy(body, &params, sizeof(params));
+    memcpy(body + sizeof(params), &cmd, sizeof(cmd));
     
     for (int i = 0; i < GT5X_PARAM_CMD_LEN; i++) {
-        chksum += buffer[i];
+        chksum += body[i];
+    }
+    
+    body[GT5X_PARAM_CMD_LEN] = (uint8_t)chksum;
+    body[GT5X_PARAM_CMD_LEN + 1] = (uint8_t)(chksum >> 8);
+    port->write(buffer, GT5X_CMD_PACKET_LEN);
+    
+    sent_cmd = cmd;
+    sent_params = params;
+    sent_data = false;
+    
+#if defined(GT5X_INSTRUMENTED)
+    sent_at = millis();
+#endif
+    GT5X_METRIC(record_call(cmd));
+    GT5X_METRIC(data.link.bytes_out += GT5X_CMD_PACKET_LEN);
+    GT5X_TRACE(GT5X_TRACE_COMMAND, cmd, params);
+    
+    /* an upload only counts if it directly follows set_template() */
+    upload_fid = GT5X_NO_FID;
+}
+
+/* ---------- incremental packet decoder ---------- */
+
+void GT5X_Decoder::begin(uint8_t start1, uint8_t start2, uint16_t len, GT5X_Sink * out, bool hold_tail) {
+    start_code = ((uint16_t)start1 << 8) | start2;
+    plen = len;
+    sink = out;
+    hold = hold_tail && (len != 0);
+    restart();
+    
+#if defined(GT5X_INSTRUMENTED)
+    resyncs = 0;
+#endif
+}
+
+/* Forget any partial packet and go back to hunting for the header,
+   keeping the expected length and sink. Rewinding the sink is up to the caller. */
+void GT5X_Decoder::restart(void) {
+    state = GT5X_STATE_READ_HEADER;
+    header = 0;
+}
+
+/* Where the next payload bytes can be read to directly, if the sink has room of its own.
+   At most *len bytes, never past the end of the payload. NULL if not in the payload
+   or the sink has no room left. */
+uint8_t * GT5X_Decoder::payload_buffer(uint16_t * len) {
+    if (state != GT5X_STATE_READ_DATA || sink == NULL)
+        return NULL;
+    
+    /* the held-back byte has to go through separately */
+    uint16_t room = remn;
+    if (hold && room == 1)
+        return NULL;
+    if (hold)
+        room--;
+    
+    /* a sink that's out of room goes through our buffer too, so its write() gets to refuse */
+    uint8_t * p = sink->acquire(len);
+    if (p == NULL || *len == 0)
+        return NULL;
+    if (*len > room)
+        *len = room;
+    
+    return p;
+}
+
+/* Max number of bytes feed() can take without running past the end of this packet.
+   While hunting for the header, at least one of them goes towards the header itself. */
+uint16_t GT5X_Decoder::wanted(void) {
+    switch (state) {
+        case GT5X_STATE_READ_HEADER:
+            return 2 + plen + 2;
+        case GT5X_STATE_READ_DEVID:
+            return (2 - nfield) + plen + 2;
+        case GT5X_STATE_READ_DATA:
+            return remn + 2;
+        case GT5X_STATE_READ_CHECKSUM:
+            return 2 - nfield;
+        default:
+            return 0;
+    }
+}
+
+/* Consume up to len bytes; returns how many were actually used, which
+   is less than len only if the packet ended before the span did. */
+uint16_t GT5X_Decoder::feed(const uint8_t * data, uint16_t len) {
+    const uint8_t * start = data;
+    const uint8_t * end = data + len;
+    
+    while (data < end) {
+        switch (state) {
+            case GT5X_STATE_READ_HEADER:
+                header <<= 8; header |= *data++;
+                if (header != start_code)
+                    break;
+                
+                state = GT5X_STATE_READ_DEVID;
+                header = 0;
+                field = 0;
+                nfield = 0;
+                chksum = (start_code >> 8) + (uint8_t)start_code;
+                break;
+            case GT5X_STATE_READ_DEVID:
+                field |= (uint16_t)*data << (8 * nfield);
+                chksum += *data++;
+                
+                if (++nfield < 2)
+                    break;
+                
+                /* check device id */
+                if (field != GT5X_DEVICEID) {
+                    state = GT5X_STATE_READ_HEADER;
+#if defined(GT5X_INSTRUMENTED)
+                    resyncs++;
+#endif
+                    break;
+                }
+                
+                remn = plen;
+                state = (remn != 0) ? GT5X_STATE_READ_DATA : GT5X_STATE_READ_CHECKSUM;
+                field = 0;
+                nfield = 0;
+                break;
+            case GT5X_STATE_READ_DATA: {
+                uint16_t n = end - data;
+                n = (n < remn) ? n : remn;
+                
+                /* running checksum, so there's no second pass once the data has landed */
+                for (uint16_t i = 0; i < n; i++) {
+                    chksum += data[i];
+                }
+                
+                if (sink != NULL) {
+                    uint16_t to_write = n;
+                    
+                    /* keep the very last byte back until the checksum is in */
+                    if (hold && n == remn) {
+                        tail = data[n - 1];
+                        to_write--;
+                    }
+                    
+                    if (to_write != 0 && !sink->write(data, to_write)) {
+                        state = GT5X_STATE_ABORTED;
+                        return data - start;
+                    }
+                }
+                
+                data += n;
+                remn -= n;
+                
+                if (remn == 0)
+                    state = GT5X_STATE_READ_CHECKSUM;
+                break;
+            }
+            case GT5X_STATE_READ_CHECKSUM:
+                field |= (uint16_t)*data++ << (8 * nfield);
+                if (++nfield < 2)
+                    break;
+                
+                if (field != chksum)
+                    state = GT5X_STATE_BAD_CHECKSUM;
+                else if (hold && !sink->write(&tail, 1))
+                    state = GT5X_STATE_ABORTED;
+                else
+                    state = GT5X_STATE_DONE;
+                
+                return data - start;
+            default:
+                return data - start;
+        }
+    }
+    
+    return data - start;
+}
+
+uint8_t GT5X_Decoder::status(void) {
+    switch (state) {
+        case GT5X_STATE_DONE:
+            return GT5X_DECODE_DONE;
+        case GT5X_STATE_BAD_CHECKSUM:
+            return GT5X_DECODE_BAD_CHECKSUM;
+        case GT5X_STATE_ABORTED:
+            return GT5X_DECODE_ABORTED;
+        default:
+            return GT5X_DECODE_BUSY;
+    }
+}
+
+/* ---------- packet reads from the port ---------- */
+
+/* Moves whatever the port has buffered into the decoder, never reading
+   past the end of the current packet. Returns true once the packet is
+   complete (good or bad), false if we need to wait for more. */
+bool GT5X::read_packet(void) {
+    while (decoder.status() == GT5X_DECODE_BUSY) {
+        uint16_t avail = port->available();
+        if (avail == 0)
+            return false;
+        
+        uint16_t room = GT5X_BUFLEN;
+        uint8_t * dest = decoder.payload_buffer(&room);
+        
+        /* payload goes straight into the sink's memory where it has some, 
+           everything else bounces through our own buffer */
+        if (dest == NULL) {
+            dest = buffer;
+            room = GT5X_BUFLEN;
+        }
+        
+        uint16_t to_read = decoder.wanted();
+        to_read = (avail < to_read) ? avail : to_read;
+        to_read = (to_read < room) ? to_read : room;
+        
+        /* one batch per pass, however the transport buffers it */
+        to_read = port->read(dest, to_read);
+        uint32_t now = millis();
+        decoder.feed(dest, to_read);
+        
+        GT5X_METRIC(data.link.bytes_in += to_read);
+#if defined(GT5X_INSTRUMENTED)
+        note_packet();
+#endif
+        
+        /* a slow sink isn't the link's fault, so its time doesn't count */
+        last_read = millis();
+        read_start += last_read - now;
+        read_active = true;
+        
+        /* a transport that gives nothing back mustn't keep us here past the deadline */
+        if (decoder.status() == GT5X_DECODE_BUSY && (to_read == 0 || read_timed_out()))
+            return false;
+    }
+    
+    return true;
+}
+
+/* ---------- instrumentation ---------- */
+
+void GT5X::init_hooks(void) {
+    set_wait_hook(NULL);
+    
+#if defined(GT5X_ENABLE_METRICS)
+    metrics = NULL;
+#endif
+
+#if defined(GT5X_ENABLE_DEBUG)
+    set_trace_hook(GT5X_print_trace, &Serial);
+#elif defined(GT5X_ENABLE_TRACE)
+    set_trace_hook(NULL);
+#endif
+}
+
+#if defined(GT5X_INSTRUMENTED)
+
+/* Tallies the outcome of the last command: GT5X_OK, the NACK code or GT5X_TIMEOUT. 
+   The ACK that lets a template/firmware upload go ahead isn't the outcome, 
+   what comes back after the data is. */
+void GT5X::note_result(uint16_t rc) {
+    uint32_t elapsed = millis() - sent_at;
+    
+    if (rc == GT5X_TIMEOUT) {
+        GT5X_TRACE(GT5X_TRACE_TIMEOUT, sent_cmd, elapsed);
+    }
+    else if (rc == GT5X_OK && !sent_data) {
+        switch (sent_cmd) {
+            case GT5X_VERIFYTEMPLATE1_1:
+            case GT5X_IDENTIFYTEMPLATE1_N:
+            case GT5X_SETTEMPLATE:
+            case GT5X_UPGRADEFIRMWARE:
+            case GT5X_UPGRADEISOCDIMAGE:
+                return;
+        }
+    }
+    
+    GT5X_METRIC(record_result(sent_cmd, rc, elapsed));
+}
+
+/* whatever the decoder ran into while being fed */
+void GT5X::note_packet(void) {
+    if (decoder.resyncs == 0)
+        return;
+    
+    GT5X_METRIC(data.link.resyncs += decoder.resyncs);
+    GT5X_TRACE(GT5X_TRACE_RESYNC, decoder.resyncs, 0);
+    decoder.resyncs = 0;
+}
+
+#endif
+
+#if defined(GT5X_ENABLE_TRACE)
+
+void GT5X::set_trace_hook(GT5X_TraceHook hook, void * ctx) {
+    trace_hook = hook;
+    trace_ctx = ctx;
+}
+
+void GT5X_print_trace(GT5X * sensor, uint8_t event, uint32_t a, uint32_t b, void * ctx) {
+    (void)sensor;
+    Print * out = (Print *)ctx;
+    
+    switch (event) {
+        case GT5X_TRACE_COMMAND:
+            out->print("[+]Command 0x"); out->print(a, HEX);
+            out->print(", params 0x"); out->println(b, HEX);
+            break;
+        case GT5X_TRACE_DATA_OUT:
+            out->print("[+]Sent data: "); out->println(a);
+            break;
+        case GT5X_TRACE_RESPONSE:
+            out->print(a == GT5X_ACK ? "[+]ACK" : "[+]NACK");
+            out->print(", params 0x"); out->println(b, HEX);
+            break;
+        case GT5X_TRACE_DATA_IN:
+            out->print("[+]Read data: "); out->println(a);
+            break;
+        case GT5X_TRACE_BAD_CHECKSUM:
+            out->println(a ? "[+]Wrong data chksum" : "[+]Wrong chksum");
+            break;
+        case GT5X_TRACE_RESYNC:
+            out->print("[+]Wrong device ID x"); out->println(a);
+            break;
+        case GT5X_TRACE_SINK_ABORTED:
+            out->println("[+]Sink aborted");
+            break;
+        case GT5X_TRACE_TIMEOUT:
+            out->print("[+]Timeout on 0x"); out->print(a, HEX);
+            out->print(" after "); out->print(b); out->println("ms");
+            break;
+        case GT5X_TRACE_BAUD:
+            out->print(b ? "[+]Link at " : "[+]Could not switch to "); out->println(a);
+            break;
+    }
+}
+
+#endif
+
+/* ---------- response timeouts ---------- */
+
+void GT5X::init_timeouts(void) {
+    timeouts[GT5X_TCLASS_FAST] = GT5X_TIMEOUT_FAST;
+    timeouts[GT5X_TCLASS_CAPTURE] = GT5X_TIMEOUT_CAPTURE;
+    timeouts[GT5X_TCLASS_ENROLL] = GT5X_TIMEOUT_ENROLL;
+    timeouts[GT5X_TCLASS_VERIFY] = GT5X_TIMEOUT_VERIFY;
+    timeouts[GT5X_TCLASS_IDENTIFY] = GT5X_TIMEOUT_IDENTIFY;
+    timeouts[GT5X_TCLASS_FLASH] = GT5X_TIMEOUT_FLASH;
+    timeouts[GT5X_TCLASS_DATA] = GT5X_TIMEOUT_DATA;
+    
+    set_adaptive_timeouts(false);
+}
+
+void GT5X::set_timeout(uint8_t tclass, uint16_t ms) {
+    if (tclass < GT5X_TCLASS_COUNT)
+        timeouts[tclass] = ms;
+}
+
+uint16_t GT5X::get_timeout(uint8_t tclass) {
+    return (tclass < GT5X_TCLASS_COUNT) ? timeouts[tclass] : 0;
+}
+
+/* turning it on (again) starts learning from scratch */
+void GT5X::set_adaptive_timeouts(bool enable) {
+    adaptive = enable;
+    memset(srtt, 0, sizeof(srtt));
+    memset(rttvar, 0, sizeof(rttvar));
+}
+
+/* ms to move len bytes at 10 bits each, rounded up */
+uint32_t GT5X::wire_time(uint16_t len) {
+    /* the rate isn't known while begin() is still looking for it */
+    uint32_t rate = (baud != 0) ? baud : GT5X_DEFAULT_BAUD;
+    return ((uint32_t)len * 10000UL + rate - 1) / rate;
+}
+
+/* ---------- command descriptors ---------- */
+
+#if defined(__AVR__)
+#define GT5X_FLASH                  PROGMEM
+#define GT5X_FLASH_BYTE(p)          pgm_read_byte(p)
+#else
+#define GT5X_FLASH
+#define GT5X_FLASH_BYTE(p)          (*(const uint8_t *)(p))
+#endif
+
+#define GT5X_CMD(op, tclass, data_tclass, data) \
+    {op, (tclass) | ((data_tclass) << GT5X_CMDF_DATA_TCLASS_SHIFT) | (data)}
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t flags;
+} GT5X_CommandInfo;
+
+/* Everything the driver needs to know about a command that isn't in its arguments. 
+   A command with an outgoing data packet ACKs straight away; the real work 
+   is answered after the data, hence the second class */
+static const GT5X_CommandInfo commands[] GT5X_FLASH = {
+    GT5X_CMD(GT5X_OPEN,                 GT5X_TCLASS_FAST,       0,                      GT5X_CMDF_DATA_IN),
+    GT5X_CMD(GT5X_CLOSE,                GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_USBINTCHECK,          GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_CHANGEBAUDRATE,       GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_SETIAPMODE,           GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_CMOSLED,              GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_GETENROLLCNT,         GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_CHECKENROLLED,        GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_STARTENROLL,          GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_ENROLL1,              GT5X_TCLASS_ENROLL,     0,                      0),
+    GT5X_CMD(GT5X_ENROLL2,              GT5X_TCLASS_ENROLL,     0,                      0),
+    GT5X_CMD(GT5X_ENROLL3,              GT5X_TCLASS_ENROLL,     0,                      0),
+    GT5X_CMD(GT5X_ISPRESSFINGER,        GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_DELETEID,             GT5X_TCLASS_FLASH,      0,                      0),
+    GT5X_CMD(GT5X_DELETEALL,            GT5X_TCLASS_FLASH,      0,                      0),
+    GT5X_CMD(GT5X_VERIFY1_1,            GT5X_TCLASS_VERIFY,     0,                      0),
+    GT5X_CMD(GT5X_IDENTIFY1_N,          GT5X_TCLASS_IDENTIFY,   0,                      0),
+    GT5X_CMD(GT5X_VERIFYTEMPLATE1_1,    GT5X_TCLASS_FAST,       GT5X_TCLASS_VERIFY,     GT5X_CMDF_DATA_OUT),
+    GT5X_CMD(GT5X_IDENTIFYTEMPLATE1_N,  GT5X_TCLASS_FAST,       GT5X_TCLASS_IDENTIFY,   GT5X_CMDF_DATA_OUT),
+    GT5X_CMD(GT5X_CAPTUREFINGER,        GT5X_TCLASS_CAPTURE,    0,                      0),
+    GT5X_CMD(GT5X_MAKETEMPLATE,         GT5X_TCLASS_CAPTURE,    0,                      GT5X_CMDF_DATA_IN),
+    GT5X_CMD(GT5X_GETIMAGE,             GT5X_TCLASS_CAPTURE,    0,                      GT5X_CMDF_DATA_IN),
+    GT5X_CMD(GT5X_GETRAWIMAGE,          GT5X_TCLASS_CAPTURE,    0,                      GT5X_CMDF_DATA_IN),
+    GT5X_CMD(GT5X_GETTEMPLATE,          GT5X_TCLASS_FAST,       0,                      GT5X_CMDF_DATA_IN),
+    GT5X_CMD(GT5X_SETTEMPLATE,          GT5X_TCLASS_FAST,       GT5X_TCLASS_IDENTIFY,   GT5X_CMDF_DATA_OUT),
+    GT5X_CMD(GT5X_GETDATABASESTART,     GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_GETDATABASEEND,       GT5X_TCLASS_FAST,       0,                      0),
+    GT5X_CMD(GT5X_UPGRADEFIRMWARE,      GT5X_TCLASS_FAST,       GT5X_TCLASS_FLASH,      GT5X_CMDF_DATA_OUT),
+    GT5X_CMD(GT5X_UPGRADEISOCDIMAGE,    GT5X_TCLASS_FAST,       GT5X_TCLASS_FLASH,      GT5X_CMDF_DATA_OUT)
+};
+
+static_assert(sizeof(commands) / sizeof(commands[0]) == GT5X_COMMAND_COUNT, 
+              "GT5X_COMMAND_COUNT has to match the descriptor table");
+
+uint8_t GT5X_command_index(uint16_t cmd) {
+    for (uint8_t i = 0; i < GT5X_COMMAND_COUNT; i++) {
+        if (GT5X_FLASH_BYTE(&commands[i].cmd) == cmd)
+            return i;
+    }
+    
+    return GT5X_COMMAND_COUNT;
+}
+
+uint16_t GT5X_command_at(uint8_t idx) {
+    return (idx < GT5X_COMMAND_COUNT) ? GT5X_FLASH_BYTE(&commands[idx].cmd) : 0;
+}
+
+uint8_t GT5X_command_flags(uint16_t cmd) {
+    uint8_t idx = GT5X_command_index(cmd);
+    return (idx < GT5X_COMMAND_COUNT) ? GT5X_FLASH_BYTE(&commands[idx].flags) : 0;
+}
+
+/* class of the response we're waiting for */
+uint8_t GT5X::timeout_class(void) {
+    uint8_t flags = GT5X_command_flags(sent_cmd);
+    if (!sent_data || !(flags & GT5X_CMDF_DATA_OUT))
+        return flags & GT5X_CMDF_TCLASS;
+    
+    /* the top byte set means no duplicate check */
+    if (sent_cmd == GT5X_SETTEMPLATE && (sent_params >> 24))
+        return GT5X_TCLASS_FLASH;
+    
+    return (flags >> GT5X_CMDF_DATA_TCLASS_SHIFT) & GT5X_CMDF_TCLASS;
+}
+
+/* how long to wait for the start of a response in the given class */
+uint32_t GT5X::response_timeout(uint8_t tclass) {
+    uint32_t limit = timeouts[tclass];
+    
+    if (tclass == GT5X_TCLASS_IDENTIFY) {
+        uint32_t ids = GT5X_MAX_SEARCH_IDS;
+        if (cache != NULL && cache->is_valid())
+            ids = cache->count();
+        limit += (ids * GT5X_IDENTIFY_US_PER_ID + 999) / 1000;
+    }
+    
+    /* srtt + 4 * rttvar, both stored x8 */
+    if (adaptive && srtt[tclass] != 0) {
+        uint32_t learned = (srtt[tclass] + 4UL * rttvar[tclass] + 7) / 8;
+        if (learned < GT5X_ADAPTIVE_MIN_TIMEOUT)
+            learned = GT5X_ADAPTIVE_MIN_TIMEOUT;
+        if (learned < limit)
+            limit = learned;
+    }
+    
+    return limit;
+}
+
+/* smoothed as in TCP's retransmission timer: gains of 1/8 and 1/4 */
+void GT5X::learn_latency(uint8_t tclass, uint32_t ms) {
+    if (!adaptive)
+        return;
+    
+    uint32_t sample = (ms < 8000) ? ms * 8 : 64000;
+    
+    if (srtt[tclass] == 0) {
+        srtt[tclass] = (sample != 0) ? sample : 1;
+        rttvar[tclass] = sample / 2;
+        return;
+    }
+    
+    uint32_t err = (sample > srtt[tclass]) ? sample - srtt[tclass] : srtt[tclass] - sample;
+    rttvar[tclass] = (3UL * rttvar[tclass] + err) / 4;
+    srtt[tclass] = (7UL * srtt[tclass] + sample) / 8;
+    if (srtt[tclass] == 0)
+        srtt[tclass] = 1;
+}
+
+void GT5X::start_read_timer(uint32_t limit) {
+    read_start = millis();
+    last_read = read_start;
+    read_limit = limit;
+    read_active = false;
+}
+
+/* Gives up once the response is later than its limit, or once a 
+   packet that has started goes quiet for more than GT5X_GAP_TIMEOUT */
+bool GT5X::read_timed_out(void) {
+    uint32_t now = millis();
+    
+    if ((uint32_t)(now - read_start) < read_limit
+        && (!read_active || (uint32_t)(now - last_read) < GT5X_GAP_TIMEOUT))
+        return false;
+    
+    return true;
+}
+
+/* ---------- waiting on the port ---------- */
+
+void GT5X::set_wait_hook(GT5X_WaitHook hook, void * ctx) {
+    wait_hook = (hook != NULL) ? hook : GT5X_wait_yield;
+    wait_ctx = ctx;
+}
+
+void GT5X::idle(void) {
+    if (pending)
+        wait_for_data();
+    else
+        yield();
+}
+
+/* nothing to parse yet, so hand the time until the read timer 
+   would run out to the wait hook */
+void GT5X::wait_for_data(void) {
+    if (port->available() != 0)
+        return;
+    
+    uint32_t now = millis();
+    uint32_t elapsed = now - read_start;
+    uint32_t left = (elapsed < read_limit) ? read_limit - elapsed : 0;
+    
+    if (read_active) {
+        uint32_t quiet = now - last_read;
+        uint32_t gap = (quiet < GT5X_GAP_TIMEOUT) ? GT5X_GAP_TIMEOUT - quiet : 0;
+        if (gap < left)
+            left = gap;
+    }
+    
+    wait_hook(port, left, wait_ctx);
+}
+
+void GT5X_wait_busy(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+    (void)port;
+    (void)max_ms;
+    (void)ctx;
+}
+
+void GT5X_wait_yield(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+    (void)port;
+    (void)max_ms;
+    (void)ctx;
+    yield();
+}
+
+/* Interrupts are held off from the last look at the port until the core is 
+   asleep, so a byte landing in between wakes it instead of being slept through */
+void GT5X_wait_sleep(GT5X_Transport * port, uint32_t max_ms, void * ctx) {
+    (void)ctx;
+    
+#if defined(__AVR__)
+    (void)max_ms;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    noInterrupts();
+    if (port->available() == 0) {
+        sleep_enable();
+        interrupts();       /* takes effect after the next instruction */
+        sleep_cpu();
+        sleep_disable();
+    }
+    interrupts();
+#elif defined(__ARM_ARCH_PROFILE) && __ARM_ARCH_PROFILE == 'M'
+    (void)max_ms;
+    __asm__ volatile ("cpsid i" ::: "memory");
+    if (port->available() == 0)
+        __asm__ volatile ("wfi" ::: "memory");
+    __asm__ volatile ("cpsie i" ::: "memory");
+#elif defined(ESP8266) || defined(ESP32)
+    (void)port;
+    delay(max_ms != 0 ? 1 : 0);
+#else
+    (void)port;
+    (void)max_ms;
+    yield();
+#endif
+}
+
+/* The one round trip behind most of the blocking methods: the response is waited 
+   for as long as the command's timeout class in the descriptor table allows. 
+   GT5X_OK with the output parameter in *out (if not NULL), the code the module 
+   NACKed with, GT5X_TIMEOUT, or GT5X_BUSY while an async command is outstanding */
+uint16_t GT5X::run_command(uint16_t cmd, uint32_t params, uint32_t * out) {
+    /* the response to an async command would be taken for ours */
+    if (is_busy())
+        return GT5X_BUSY;
+    
+    write_cmd_packet(cmd, params);
+    return get_cmd_response(out);
+}
+
+/* Blocks until the response is in. GT5X_OK with the output parameter 
+   in *out, GT5X_TIMEOUT, or the code the module NACKed with */
+uint16_t GT5X::get_cmd_response(uint32_t * out) {
+    reset_cmd_response();
+    
+    while (!read_cmd_response()) {
+        wait_for_data();
+    }
+    
+    return response_result(out);
+}
+
+uint16_t GT5X::response_result(uint32_t * out) {
+    if (resp_code == GT5X_ACK) {
+        if (out != NULL)
+            *out = resp_params;
+        return GT5X_OK;
+    }
+    else if (resp_code == GT5X_TIMEOUT)
+        return resp_code;
+    
+    return resp_params;
+}
+
+void GT5X::reset_cmd_response(void) {
+    resp_sink.reset(resp, GT5X_PARAM_CMD_LEN);
+    decoder.begin(GT5X_CMD_START_CODE1, GT5X_CMD_START_CODE2, GT5X_PARAM_CMD_LEN, &resp_sink);
+    
+    start_read_timer(response_timeout(timeout_class()) + wire_time(GT5X_CMD_PACKET_LEN));
+}
+
+/* Advances the response parser as far as the bytes already received allow,
+   without waiting for more. Returns true once a full response has been read
+   (or we've timed out), with the result in resp_code and resp_params */
+   
+bool GT5X::read_cmd_response(void) {
+    while (read_packet()) {
+        if (decoder.status() == GT5X_DECODE_DONE) {
+            /* output parameter or error code, then ACK/NACK */
+            memcpy(&resp_params, resp, 4);
+            memcpy(&resp_code, resp + 4, 2);
+            
+            GT5X_TRACE(GT5X_TRACE_RESPONSE, resp_code, resp_params);
+#if defined(GT5X_INSTRUMENTED)
+            note_result(resp_code == GT5X_ACK ? GT5X_OK : resp_params);
+#endif
+            
+            /* NACKs like "finger not pressed" come back early, they'd drag the estimate down */
+            if (resp_code == GT5X_ACK)
+                learn_latency(timeout_class(), millis() - read_start);
+            return true;
+        }
+        
+        /* bad checksum, wait for another */
+        GT5X_METRIC(data.link.bad_checksums++);
+        GT5X_TRACE(GT5X_TRACE_BAD_CHECKSUM, 0, 0);
+        resp_sink.rewind();
+        decoder.restart();
+        read_active = false;
+    }
+    
+    if (read_timed_out()) {
+        /* whatever was learned for this class is no good */
+        uint8_t tclass = timeout_class();
+        srtt[tclass] = 0;
+        rttvar[tclass] = 0;
+        
+#if defined(GT5X_INSTRUMENTED)
+        note_result(GT5X_TIMEOUT);
+#endif
+        resp_code = GT5X_TIMEOUT;
+        return true;
+    }
+    
+    return false;
+}
+
+/* Returns len on success, GT5X_BAD_CHECKSUM if the packet was corrupted, GT5X_ABORTED
+   if the sink refused the data or GT5X_TIMEOUT if it never arrived in full. With hold_tail, 
+   the last payload byte is only passed on once the checksum has been verified. */
+   
+uint16_t GT5X::get_data_response(GT5X_Sink * sink, uint16_t len, bool hold_tail) {
+    decoder.begin(GT5X_DATA_START_CODE1, GT5X_DATA_START_CODE2, len, sink, hold_tail);
+    start_read_timer(timeouts[GT5X_TCLASS_DATA] + wire_time(len + GT5X_FRAME_OVERHEAD));
+    
+    while (true) {
+        if (read_packet()) {
+            uint8_t status = decoder.status();
+            if (status == GT5X_DECODE_DONE) {
+                GT5X_TRACE(GT5X_TRACE_DATA_IN, len, 0);
+                return len;
+            }
+            else if (status == GT5X_DECODE_ABORTED) {
+                GT5X_METRIC(data.link.sink_aborts++);
+                GT5X_TRACE(GT5X_TRACE_SINK_ABORTED, 0, 0);
+                return GT5X_ABORTED;
+            }
+            
+            /* the module never sends a data packet twice */
+            GT5X_METRIC(data.link.bad_checksums++);
+            GT5X_TRACE(GT5X_TRACE_BAD_CHECKSUM, 1, 0);
+            return GT5X_BAD_CHECKSUM;
+        }
+        
+        if (read_timed_out())
+            break;
+        
+        wait_for_data();
+    }
+    
+    GT5X_METRIC(data.link.data_timeouts++);
+    GT5X_TRACE(GT5X_TRACE_TIMEOUT, sent_cmd, millis() - read_start);
+    return GT5X_TIMEOUT;
+}
+
+GT5X::GT5X(Stream * ss) : stream_port(ss), port(&stream_port), raw_error(GT5X_OK), pending(false), callback(NULL), callback_ctx(NULL),
+                           pipe_stage(GT5X_PIPE_IDLE), baud(GT5X_DEFAULT_BAUD), cache(NULL), enroll_fid(GT5X_NO_FID), upload_fid(GT5X_NO_FID)
+{
+    init_timeouts();
+    init_hooks();
+}
+
+GT5X::GT5X(GT5X_Transport * transport) : stream_port(NULL), port(transport), raw_error(GT5X_OK), pending(false), callback(NULL), 
+                           callback_ctx(NULL), pipe_stage(GT5X_PIPE_IDLE), baud(GT5X_DEFAULT_BAUD), cache(NULL), 
+                           enroll_fid(GT5X_NO_FID), upload_fid(GT5X_NO_FID)
+{
+    init_timeouts();
+    init_hooks();
+}
+
+/* Non-blocking counterpart to the methods below: sends the command and returns
+   immediately. Call poll() from the main loop until it returns false. */
+bool GT5X::start_command(uint16_t cmd, uint32_t params, GT5X_Callback cb, void * ctx) {
+    /* the identify pipeline owns the sensor until it's done */
+    if (pending || pipe_stage != GT5X_PIPE_IDLE)
+        return false;
+    
+    send_command(cmd, params, cb, ctx);
+    return true;
+}
+
+bool GT5X::start_data(const uint8_t * data, uint16_t len, GT5X_Callback cb, void * ctx) {
+    if (pending || pipe_stage != GT5X_PIPE_IDLE)
+        return false;
+    
+    write_data_packet(data, len);
+    expect_response(cb, ctx);
+    return true;
+}
+
+void GT5X::send_command(uint16_t cmd, uint32_t params, GT5X_Callback cb, void * ctx) {
+    write_cmd_packet(cmd, params);
+    expect_response(cb, ctx);
+}
+
+/* wait for a response without sending anything, e.g. after a data packet */
+void GT5X::expect_response(GT5X_Callback cb, void * ctx) {
+    callback = cb;
+    callback_ctx = ctx;
+    
+    reset_cmd_response();
+    pending = true;
+}
+
+/* Returns true while a command started with start_command() 
+   or an identify started with start_identify() is still outstanding */
+bool GT5X::poll(void) {
+    if (!pending) {
+        tick_pipeline();
+        return is_busy();
     }
     
-    port->write(preamble, sizeof(preamble));
-    port->write(buffer, GT5X_PARAM_CMD_LEN);
-    port->write((uint8_t *)&chksum, 2);
+    if (!read_cmd_response())
+        return true;
+    
+    pending = false;
+    
+    if (callback != NULL) {
+        uint32_t param = 0;
+        uint16_t rc = get_result(&param);
+        callback(this, rc, param, callback_ctx);
+    }
+    
+    /* the callback may well have started the next command */
+    return is_busy();
+}
+
+bool GT5X::is_busy(void) {
+    return pending || pipe_stage != GT5X_PIPE_IDLE;
+}
+
+/* Same codes as the blocking methods: GT5X_OK, a NACK code or GT5X_TIMEOUT,
+   with the output parameter (if any) in param on success */
+uint16_t GT5X::get_result(uint32_t * param) {
+    if (pending)
+        return GT5X_BUSY;
+    
+    return response_result(param);
+}
+
+/* ---------- capture -> identify pipeline ---------- */
+
+/* Non-blocking 1:N identification: LED on, poll for a finger, capture, 
+   search the database, LED off. Checks for a finger start back-to-back and 
+   back off the longer the sensor stays idle. With wait_ms = 0, waits for a finger 
+   indefinitely. cb gets the matched ID as its param. */
+bool GT5X::start_identify(uint32_t wait_ms, bool highquality, GT5X_Callback cb, void * ctx) {
+    if (pending || pipe_stage != GT5X_PIPE_IDLE)
+        return false;
+    
+    pipe_cb = cb;
+    pipe_ctx = ctx;
+    pipe_wait = wait_ms;
+    pipe_hq = highquality;
+    pipe_interval = 0;
+    
+    memset(&pipe_timing, 0, sizeof(pipe_timing));
+    pipe_start = millis();
+    pipe_mark = pipe_start;
+    
+    pipe_stage = GT5X_PIPE_LED_ON;
+    send_command(GT5X_CMOSLED, 1, pipeline_step, this);
+    
+    return true;
+}
+
+/* blocking version of the above */
+uint16_t GT5X::identify_finger(uint16_t * fid, uint32_t wait_ms, bool highquality) {
+    if (!start_identify(wait_ms, highquality))
+        return GT5X_BUSY;
+    
+    while (poll()) {
+        idle();
+    }
+    
+    *fid = pipe_fid;
+    return pipe_rc;
+}
+
+/* Non-blocking identify_template(): the template goes out once the module ACKs 
+   the command, then the match result comes back. cb gets the matched ID as its param. 
+   tmpl must stay valid until then. */
+bool GT5X::start_identify_template(const uint8_t * tmpl, GT5X_Callback cb, void * ctx) {
+    if (pending || pipe_stage != GT5X_PIPE_IDLE)
+        return false;
+    
+    pipe_cb = cb;
+    pipe_ctx = ctx;
+    pipe_tmpl = tmpl;
+    
+    pipe_stage = GT5X_PIPE_SEND_TEMPLATE;
+    send_command(GT5X_IDENTIFYTEMPLATE1_N, 0, pipeline_step, this);
+    
+    return true;
+}
+
+void GT5X::get_identify_timing(GT5X_IdentifyTiming * timing) {
+    memcpy(timing, &pipe_timing, sizeof(GT5X_IdentifyTiming));
+}
+
+void GT5X::pipeline_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    (void)ctx;
+    sensor->advance_pipeline(rc, param);
 }
 
-/* Any output parameter (or error code) is stored right back into params
-   and the Response ACK/NACK is returned */
-   
-uint16_t GT5X::get_cmd_response(uint32_t * params) {
-    GT5X_State state = GT5X_STATE_READ_HEADER;
-    const uint16_t COMBINED_PACKET_HEADER = ((uint16_t)GT5X_CMD_START_CODE1 << 8) | GT5X_CMD_START_CODE2;
+void GT5X::advance_pipeline(uint16_t rc, uint32_t param) {
+    uint32_t now = millis();
     
-    uint16_t header = 0;
-    uint16_t rcode = 0;
-    uint32_t last_read = millis();
-    
-    while ((uint32_t)(millis() - last_read) < GT5X_DEFAULT_TIMEOUT) {
-        yield();
-        
-        switch (state) {
-            case GT5X_STATE_READ_HEADER: {
-                if (port->available() == 0)
-                    continue;
-                
-                last_read = millis();
-                uint8_t byte = port->read();
-                header <<= 8; header |= byte;
-                if (header != COMBINED_PACKET_HEADER)
-                    break;
-                
-                state = GT5X_STATE_READ_DEVID;
-                header = 0;
-                
-                GT5X_DEBUG_PRINTLN("\r\n[+]Got header");
-                break;
+    switch (pipe_stage) {
+        case GT5X_PIPE_LED_ON:
+            if (rc != GT5X_OK) {
+                finish_pipeline(rc, 0);
+                return;
             }
-            case GT5X_STATE_READ_DEVID: {
-                if (port->available() < 2)
-                    continue;
-                
-                last_read = millis();
-                uint16_t devid;
-                port->readBytes((uint8_t *)&devid, 2);
-                
-                /* check device id */
-                if (devid != GT5X_DEVICEID) {
-                    state = GT5X_STATE_READ_HEADER;
-                    GT5X_DEBUG_PRINTLN("[+]Wrong device ID");
-                    break;
-                }
-                
-                state = GT5X_STATE_READ_PARAMS;
-                GT5X_DEBUG_PRINT("[+]ID: 0x"); GT5X_DEBUG_HEXLN(devid);
-                
-                break;
+            
+            pipe_stage = GT5X_PIPE_PRESENCE;
+            pipe_timing.polls++;
+            send_command(GT5X_ISPRESSFINGER, 0, pipeline_step, this);
+            return;
+        case GT5X_PIPE_PRESENCE:
+            if (rc != GT5X_OK) {
+                finish_pipeline(rc, 0);
+                return;
             }
-            case GT5X_STATE_READ_PARAMS:
-                if (port->available() < 4)
-                    continue;
-                
-                /* store output parameter or error code */
-                last_read = millis();
-                port->readBytes((uint8_t *)params, 4);
-                
-                state = GT5X_STATE_READ_RESPONSE;
-                GT5X_DEBUG_PRINT("[+]Params: 0x"); GT5X_DEBUG_HEXLN(*params);
-                
-                break;
-            case GT5X_STATE_READ_RESPONSE: {
-                if (port->available() < 2)
-                    continue;
-                
-                /* read ACK/NACK */
-                last_read = millis();
-                port->readBytes((uint8_t *)&rcode, 2);
-                
-                state = GT5X_STATE_READ_CHECKSUM;
-                GT5X_DEBUG_PRINT("[+]Response code: "); GT5X_DEBUG_DECLN(rcode);
-                break;
+            
+            /* 0 means a finger is down, go straight to capture */
+            if (param == 0) {
+                pipe_timing.wait = now - pipe_start;
+                pipe_mark = now;
+                pipe_stage = GT5X_PIPE_CAPTURE;
+                pipe_timing.captures++;
+                send_command(GT5X_CAPTUREFINGER, pipe_hq ? 1 : 0, pipeline_step, this);
+                return;
             }
-            case GT5X_STATE_READ_CHECKSUM: {
-                if (port->available() < 2)
-                    continue;
-                
-                last_read = millis();
-                uint16_t temp;
-                port->readBytes((uint8_t *)&temp, 2);
-                
-                uint16_t chksum = GT5X_CMD_START_CODE1 + GT5X_CMD_START_CODE2
-                                  + (uint8_t)GT5X_DEVICEID + (GT5X_DEVICEID >> 8);
-                
-                /* 4 from size of params */
-                for (int i = 0; i < 4; i++) {
-                    chksum += ((uint8_t *)params)[i];
-                }
-                
-                chksum += rcode >> 8;
-                chksum += (uint8_t)rcode;
-                
-                /* compare chksum */
-                if (temp != chksum) {
-                    state = GT5X_STATE_READ_HEADER;
-                    GT5X_DEBUG_PRINTLN("\r\n[+]Wrong chksum");
-                    continue;
-                }
-                
-                GT5X_DEBUG_PRINTLN("\r\n[+]Read complete");
-                return rcode;
+            
+            wait_for_finger();
+            return;
+        case GT5X_PIPE_CAPTURE:
+            if (rc == GT5X_OK) {
+                pipe_timing.capture = now - pipe_mark;
+                pipe_mark = now;
+                pipe_stage = GT5X_PIPE_IDENTIFY;
+                send_command(GT5X_IDENTIFY1_N, 0, pipeline_step, this);
+                return;
             }
+            
+            /* finger lifted or smudged, keep watching without backing off */
+            if (rc == GT5X_NACK_FINGER_IS_NOT_PRESSED || rc == GT5X_NACK_BAD_FINGER) {
+                pipe_interval = 0;
+                wait_for_finger();
+                return;
+            }
+            
+            finish_pipeline(rc, 0);
+            return;
+        case GT5X_PIPE_IDENTIFY:
+            pipe_timing.identify = now - pipe_mark;
+            finish_pipeline(rc, param);
+            return;
+        case GT5X_PIPE_LED_OFF: {
+            /* report the identify result, not the LED's */
+            pipe_timing.total = now - pipe_start;
+            pipe_stage = GT5X_PIPE_IDLE;
+            
+            if (pipe_cb != NULL)
+                pipe_cb(this, pipe_rc, pipe_fid, pipe_ctx);
+            return;
         }
+        case GT5X_PIPE_SEND_TEMPLATE:
+            if (rc == GT5X_OK) {
+                write_data_packet(pipe_tmpl, GT5X_TEMPLATESZ);
+                pipe_stage = GT5X_PIPE_MATCH_TEMPLATE;
+                expect_response(pipeline_step, this);
+                return;
+            }
+            
+            finish_template(rc, 0);
+            return;
+        case GT5X_PIPE_MATCH_TEMPLATE:
+            finish_template(rc, (rc == GT5X_OK) ? param : 0);
+            return;
+        default:
+            return;
+    }
+}
+
+/* schedule the next presence check, or give up if we've waited long enough */
+void GT5X::wait_for_finger(void) {
+    if (pipe_wait != 0 && (uint32_t)(millis() - pipe_start) >= pipe_wait) {
+        finish_pipeline(GT5X_NACK_FINGER_IS_NOT_PRESSED, 0);
+        return;
     }
     
-    GT5X_DEBUG_PRINTLN("[+]Timeout.");
-    return GT5X_TIMEOUT;
+    pipe_stage = GT5X_PIPE_WAIT;
+    pipe_mark = millis();
 }
 
-uint16_t GT5X::get_data_response(uint8_t * data, uint16_t len, Stream * outStream) {
-    GT5X_State state = GT5X_STATE_READ_HEADER;
-    const uint16_t COMBINED_PACKET_HEADER = ((uint16_t)GT5X_DATA_START_CODE1 << 8) | GT5X_DATA_START_CODE2;
+/* called from poll() while there's no command in flight */
+void GT5X::tick_pipeline(void) {
+    if (pipe_stage != GT5X_PIPE_WAIT)
+        return;
     
-    uint16_t header = 0;
+    if ((uint32_t)(millis() - pipe_mark) < pipe_interval)
+        return;
     
-    uint16_t remn = len;
-    uint32_t last_read = millis();
+    /* back off gradually while nobody's there */
+    pipe_interval += GT5X_POLL_STEP;
+    if (pipe_interval > GT5X_POLL_MAX_INTERVAL)
+        pipe_interval = GT5X_POLL_MAX_INTERVAL;
     
-    while ((uint32_t)(millis() - last_read) < GT5X_DEFAULT_TIMEOUT) {
-        yield();
-        
-        switch (state) {
-            case GT5X_STATE_READ_HEADER: {
-                if (port->available() == 0)
-                    continue;
-                
-                last_read = millis();
-                uint8_t byte = port->read();
-                header <<= 8; header |= byte;
-                if (header != COMBINED_PACKET_HEADER)
-                    break;
-                
-                state = GT5X_STATE_READ_DEVID;
-                header = 0;
-                
-                GT5X_DEBUG_PRINTLN("\r\n[+]Got header");
-                break;
-            }
-            case GT5X_STATE_READ_DEVID: {
-                if (port->available() < 2)
-                    continue;
-                
-                last_read = millis();
-                uint16_t devid;
-                port->readBytes((uint8_t *)&devid, 2);
-                
-                if (devid != GT5X_DEVICEID) {
-                    state = GT5X_STATE_READ_HEADER;
-                    GT5X_DEBUG_PRINTLN("[+]Wrong device ID");
-                    break;
-                }
-                
-                state = GT5X_STATE_READ_DATA;
-                GT5X_DEBUG_PRINT("[+]ID: 0x"); GT5X_DEBUG_HEXLN(devid);
-                
-                break;
-            }
-            case GT5X_STATE_READ_DATA: {
-                uint16_t avail = port->available();
-                uint16_t to_read;
-                
-                if (avail == 0)
-                    continue;
-                
-                last_read = millis();
-                
-                if (outStream == NULL) {
-                    to_read = (avail < remn) ? avail : remn;
-                    port->readBytes(data, to_read);
-                    data += to_read;
-                }
-                else {
-                    to_read = (avail < remn) ? avail : remn;
-                    to_read = (to_read < GT5X_BUFLEN) ? to_read : GT5X_BUFLEN;
-                    port->readBytes(buffer, to_read);
-                    outStream->write(buffer, to_read);
-                }
-                
-                remn -= to_read;
-                
-                if (remn == 0) {
-                    state = GT5X_STATE_READ_CHECKSUM;
-                    GT5X_DEBUG_PRINT("[+]Read len: "); GT5X_DEBUG_DECLN(len);
-                }
-                
-                break;
-            }
-            case GT5X_STATE_READ_CHECKSUM: {
-                if (port->available() < 2)
-                    continue;
-                
-                last_read = millis();
-                uint16_t temp;
-                port->readBytes((uint8_t *)&temp, 2);
-                
-                if (outStream == NULL) {
-                    uint16_t chksum = GT5X_DATA_START_CODE1 + GT5X_DATA_START_CODE2
-                                      + (uint8_t)GT5X_DEVICEID + (GT5X_DEVICEID >> 8);
-                    
-                    /* walk backwards thru the data and add */                    
-                    for (int i = 0; i < len; i++) {
-                        chksum += *(--data);
-                    }
-                    
-                    if (temp != chksum) {
-                        state = GT5X_STATE_READ_HEADER;
-                        GT5X_DEBUG_PRINTLN("\r\n[+]Wrong chksum");
-                        continue;
-                    }
-                }
-                
-                GT5X_DEBUG_PRINTLN("\r\n[+]Read complete");
-                return len;
-            }
-        }
-    }
+    pipe_stage = GT5X_PIPE_PRESENCE;
+    pipe_timing.polls++;
+    send_command(GT5X_ISPRESSFINGER, 0, pipeline_step, this);
+}
+
+void GT5X::finish_pipeline(uint16_t rc, uint32_t fid) {
+    pipe_rc = rc;
+    pipe_fid = fid;
     
-    GT5X_DEBUG_PRINTLN();
-    return GT5X_TIMEOUT;
+    /* LED goes off whatever happened */
+    pipe_stage = GT5X_PIPE_LED_OFF;
+    send_command(GT5X_CMOSLED, 0, pipeline_step, this);
 }
 
-GT5X::GT5X(Stream * ss) : port(ss) 
-{
+/* no LED to turn off here, report straight away */
+void GT5X::finish_template(uint16_t rc, uint32_t fid) {
+    pipe_rc = rc;
+    pipe_fid = fid;
+    pipe_stage = GT5X_PIPE_IDLE;
     
+    if (pipe_cb != NULL)
+        pipe_cb(this, pipe_rc, pipe_fid, pipe_ctx);
 }
 
 bool GT5X::begin(GT5X_DeviceInfo * info) {
-    uint16_t cmd = GT5X_OPEN;
-    uint32_t params = 1;
+    if (run_command(GT5X_OPEN, 1) != GT5X_OK)
+        return false;
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
+    /* read and dropped if the caller doesn't want it */
+    GT5X_DeviceInfo scratch;
+    if (info == NULL)
+        info = &scratch;
     
-    if (rc != GT5X_ACK)
-        return false;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    GT5X_BufferSink sink((uint8_t *)info, sizeof(GT5X_DeviceInfo));
+    return get_data_response(&sink, sizeof(GT5X_DeviceInfo)) == sizeof(GT5X_DeviceInfo);
+}
+
+static const uint32_t baud_rates[] = {9600, 19200, 38400, 57600, 115200};
+#define GT5X_NUM_BAUD_RATES     (sizeof(baud_rates) / sizeof(baud_rates[0]))
+
+bool GT5X::begin(GT5X_DeviceInfo * info, GT5X_PortConfig set_port, void * ctx, uint32_t max_baud) {
+    if (set_port == NULL)
+        return begin(info);
     
-    rc = get_data_response((uint8_t *)&devinfo, sizeof(GT5X_DeviceInfo));
-    if (rc != sizeof(GT5X_DeviceInfo))
+    baud = probe_baud(set_port, ctx, info, max_baud);
+    if (baud == 0) {
+        baud = GT5X_DEFAULT_BAUD;
         return false;
+    }
     
-    if (info != NULL) {
-        memcpy(info, &devinfo, sizeof(GT5X_DeviceInfo));
+    /* fastest first; a rate that won't hold just means trying the next one down.
+       A module found above the cap is brought down to it */
+    for (int8_t i = GT5X_NUM_BAUD_RATES - 1; i >= 0; i--) {
+        if (baud_rates[i] > max_baud)
+            continue;
+        if ((baud <= max_baud && baud_rates[i] <= baud) || switch_baud(baud_rates[i], set_port, ctx, info, max_baud))
+            break;
+        if (baud == 0) {
+            baud = GT5X_DEFAULT_BAUD;
+            return false;
+        }
     }
     
+    GT5X_TRACE(GT5X_TRACE_BAUD, baud, 1);
     return true;
 }
 
-bool GT5X::end(void) {
-    uint16_t cmd = GT5X_CLOSE;
-    uint32_t params = 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    return (rc == GT5X_ACK);
+/* garbage left over from talking at the wrong rate */
+void GT5X::flush_port(void) {
+    delay(2);
+    port->discard();
 }
 
-uint16_t GT5X::set_led(bool state) {
-    uint16_t cmd = GT5X_CMOSLED;
-    uint32_t params = state ? 1 : 0;
+/* try OPEN at each rate up to max_baud until the module answers, starting with the one 
+   the port is at. Returns the rate found, or 0 if there was no reply at any of them, 
+   with the port back at the power-up rate. Every successful OPEN leaves 
+   the device info in info, the last one wins */
+uint32_t GT5X::probe_baud(GT5X_PortConfig set_port, void * ctx, GT5X_DeviceInfo * info, uint32_t max_baud) {
+    if (begin(info))
+        return baud;
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    for (int8_t i = GT5X_NUM_BAUD_RATES - 1; i >= 0; i--) {
+        if (baud_rates[i] == baud || baud_rates[i] > max_baud)
+            continue;
+        
+        set_port(baud_rates[i], ctx);
+        flush_port();
+        if (begin(info))
+            return baud_rates[i];
+    }
     
-    return params;
+    set_port(GT5X_DEFAULT_BAUD, ctx);
+    flush_port();
+    return 0;
 }
 
-/* trust the device to handle invalid rates, 
- * will need to call end() and begin() after this */
-uint16_t GT5X::set_baud_rate(uint32_t baud) {
-    uint16_t cmd = GT5X_CHANGEBAUDRATE;
-    uint32_t params = baud;
+/* move both ends to a new rate and make sure they can still hear each other; 
+   if not, find wherever the module ended up */
+bool GT5X::switch_baud(uint32_t rate, GT5X_PortConfig set_port, void * ctx, GT5X_DeviceInfo * info, uint32_t max_baud) {
+    uint32_t old = baud;
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    /* the ACK comes back at the old rate */
+    if (set_baud_rate(rate) == GT5X_OK) {
+        set_port(rate, ctx);
+        flush_port();
+        if (begin(info))
+            return true;
+    }
+    
+    GT5X_TRACE(GT5X_TRACE_BAUD, rate, 0);
+    
+    set_port(old, ctx);
+    flush_port();
+    baud = old;
+    if (begin(info))
+        return false;
+    
+    /* 0 if the module's gone quiet altogether */
+    baud = probe_baud(set_port, ctx, info, max_baud);
+    return false;
+}
+
+bool GT5X::end(void) {
+    return run_command(GT5X_CLOSE, 0) == GT5X_OK;
+}
+
+uint16_t GT5X::set_led(bool state) {
+    return run_command(GT5X_CMOSLED, state ? 1 : 0);
+}
+
+/* trust the device to handle invalid rates, will need to reopen the port 
+ * and call begin() after this; or let begin() negotiate the rate instead */
+uint16_t GT5X::set_baud_rate(uint32_t rate) {
+    uint16_t rc = run_command(GT5X_CHANGEBAUDRATE, rate);
+    if (rc == GT5X_OK) {
+        baud = rate;
+        
+        /* learned latencies include time on the wire */
+        set_adaptive_timeouts(adaptive);
+    }
     
-    /* returns the NACK error code, same purpose in other functions */
-    return params;
+    return rc;
 }
 
 /* get number of enrolled templates */
 uint16_t GT5X::get_enrolled_count(uint16_t * fcnt) {
-    uint16_t cmd = GT5X_GETENROLLCNT;
-    uint32_t params = 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK) {
-        *fcnt = params;
+    if (cache != NULL && cache->is_valid()) {
+        cache->stats.hits++;
+        *fcnt = cache->count();
         return GT5X_OK;
     }
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
     
-    return params;
+    uint32_t count = 0;
+    uint16_t rc = run_command(GT5X_GETENROLLCNT, 0, &count);
+    if (rc == GT5X_OK)
+        *fcnt = count;
+    
+    return rc;
 }
 
 /* IDs 0-2999, if using GT-521F52
  * IDs 0-199, if using GT-521F32/GT-511C3 */
 uint16_t GT5X::is_enrolled(uint16_t fid) {
-    uint16_t cmd = GT5X_CHECKENROLLED;
-    uint32_t params = fid;
+    if (cache != NULL) {
+        if (cache->is_valid() && fid < cache->capacity()) {
+            cache->stats.hits++;
+            return cache->is_used(fid) ? GT5X_OK : GT5X_NACK_IS_NOT_USED;
+        }
+        
+        cache->stats.misses++;
+    }
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    uint16_t rc = run_command(GT5X_CHECKENROLLED, fid);
+    if (rc == GT5X_OK || rc == GT5X_NACK_IS_NOT_USED)
+        cache_mark(fid, rc == GT5X_OK);
     
-    return params;
+    return rc;
 }
 
 /** Starts the enrollment process
@@ -381,231 +1343,291 @@ uint16_t GT5X::is_enrolled(uint16_t fid) {
  *  0-199, if using GT-521F32/GT-511C3
  */
 uint16_t GT5X::start_enroll(uint16_t fid) {
-    uint16_t cmd = GT5X_STARTENROLL;
-    uint32_t params = fid;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    uint16_t rc = run_command(GT5X_STARTENROLL, fid);
+    if (rc == GT5X_OK)
+        enroll_fid = fid;
     
-    return params;
+    return rc;
 }
 
 /** Scan finger for enrollment
  *  
  */
 uint16_t GT5X::enroll_scan(uint8_t pass) {
-    uint16_t cmd;
+    /* Enroll1-3 are consecutive */
+    uint16_t cmd = (pass >= 1 && pass <= 3) ? GT5X_ENROLL1 + pass - 1 : GT5X_ENROLL3;
     
-    switch (pass) {
-        case 1:
-            cmd = GT5X_ENROLL1;
-            break;
-        case 2:
-            cmd = GT5X_ENROLL2;
-            break;
-        default:
-            cmd = GT5X_ENROLL3;
-            break;
+    uint16_t rc = run_command(cmd, 0);
+    if (rc == GT5X_OK) {
+        /* the template only lands in the database after the last pass */
+        if (cmd == GT5X_ENROLL3) {
+            cache_mark(enroll_fid, true);
+            enroll_fid = GT5X_NO_FID;
+        }
     }
+    /* any failure ends the enrollment */
+    else if (rc != GT5X_TIMEOUT)
+        enroll_fid = GT5X_NO_FID;
     
-    uint32_t params = 0;
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
-    
-    return params;
+    return rc;
 }
 
 bool GT5X::is_pressed(void) {
-    uint16_t cmd = GT5X_ISPRESSFINGER;
-    uint32_t params = 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK) {
-        return params == 0;
-    }
-    else
-        return rc;
+    uint32_t state = 0;
+    uint16_t rc = run_command(GT5X_ISPRESSFINGER, 0, &state);
+    return (rc != GT5X_OK) || state == 0;
 }
 
 uint16_t GT5X::delete_id(uint16_t fid) {
-    uint16_t cmd = GT5X_DELETEID;
-    uint32_t params = fid;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    uint16_t rc = run_command(GT5X_DELETEID, fid);
+    if (rc == GT5X_OK)
+        cache_mark(fid, false);
     
-    return params;
+    return rc;
 }
 
 uint16_t GT5X::empty_database(void) {
-    uint16_t cmd = GT5X_DELETEALL;
-    uint32_t params = 0;
+    uint16_t rc = run_command(GT5X_DELETEALL, 0);
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    /* an empty database is as known as it gets */
+    if (rc == GT5X_OK && cache != NULL) {
+        cache->clear();
+        cache->set_valid(true);
+    }
     
-    return params;
+    return rc;
 }
 
 /* For 1:1 matching */
 uint16_t GT5X::verify_finger_with_template(uint16_t fid) {
-    uint16_t cmd = GT5X_VERIFY1_1;
-    uint32_t params = fid;
+    return run_command(GT5X_VERIFY1_1, fid);
+}
+
+uint16_t GT5X::search_database(uint16_t * fid) {
+    uint32_t found = 0;
+    uint16_t rc = run_command(GT5X_IDENTIFY1_N, 0, &found);
+    if (rc == GT5X_OK)
+        *fid = found;
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
+    return rc;
+}
+
+/* command, then the template in a data packet once the module ACKs; 
+   the final response is for the match itself */
+uint16_t GT5X::send_template(uint16_t cmd, uint32_t params, const uint8_t * tmpl, uint32_t * result) {
+    uint16_t rc = run_command(cmd, params);
+    if (rc != GT5X_OK)
         return rc;
     
-    return params;
+    write_data_packet(tmpl, GT5X_TEMPLATESZ);
+    return get_cmd_response(result);
 }
 
-uint16_t GT5X::search_database(uint16_t * fid) {
-    uint16_t cmd = GT5X_IDENTIFY1_N;
+uint16_t GT5X::verify_template(uint16_t fid, const uint8_t * tmpl) {
     uint32_t params = 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK) {
+    return send_template(GT5X_VERIFYTEMPLATE1_1, fid, tmpl, &params);
+}
+
+uint16_t GT5X::identify_template(const uint8_t * tmpl, uint16_t * fid) {
+    uint32_t params = 0;
+    uint16_t rc = send_template(GT5X_IDENTIFYTEMPLATE1_N, 0, tmpl, &params);
+    if (rc == GT5X_OK)
         *fid = params;
-        return GT5X_OK;
-    }
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
     
-    return params;
+    return rc;
 }
 
 uint16_t GT5X::capture_finger(bool highquality) {
-    uint16_t cmd = GT5X_CAPTUREFINGER;
-    uint32_t params = highquality ? 1 : 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
-    
-    return params;
+    return run_command(GT5X_CAPTUREFINGER, highquality ? 1 : 0);
 }
 
 uint16_t GT5X::get_template(uint16_t fid) {
-    uint16_t cmd = GT5X_GETTEMPLATE;
-    uint32_t params = fid;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
-    
-    return params;
+    return run_command(GT5X_GETTEMPLATE, fid);
+}
+
+uint16_t GT5X::make_template(void) {
+    return run_command(GT5X_MAKETEMPLATE, 0);
 }
 
 uint16_t GT5X::get_image(void) {
-    uint16_t cmd = GT5X_GETRAWIMAGE;
-    uint32_t params = 0;
-    
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
-    
-    return params;
+    return run_command(GT5X_GETRAWIMAGE, 0);
 }
 
 uint16_t GT5X::set_template(uint16_t fid, uint8_t check_duplicate) {
-    uint16_t cmd = GT5X_SETTEMPLATE;
-    uint32_t params = check_duplicate ? fid : (fid | 0xff000000);
+    uint16_t rc = run_command(GT5X_SETTEMPLATE, check_duplicate ? fid : (fid | 0xff000000));
     
-    write_cmd_packet(cmd, params);
-    uint16_t rc = get_cmd_response(&params);
-    if (rc == GT5X_ACK)
-        return GT5X_OK;
-    else if (rc == GT5X_TIMEOUT)
-        return rc;
+    /* the cache is updated once write_raw() gets its response */
+    if (rc == GT5X_OK)
+        upload_fid = fid;
     
-    return params;
+    return rc;
 }
 
 bool GT5X::read_raw(uint8_t outType, void * out, uint16_t to_read) {
-    Stream * outStream;
-    uint8_t * outBuf;
+    if (outType == GT5X_OUTPUT_TO_BUFFER) {
+        GT5X_BufferSink sink((uint8_t *)out, to_read);
+        return read_raw(&sink, to_read);
+    }
+    else if (outType == GT5X_OUTPUT_TO_STREAM || outType == GT5X_OUTPUT_TO_STREAM_VERIFIED) {
+        GT5X_StreamSink sink((Stream *)out);
+        return read_raw(&sink, to_read, outType == GT5X_OUTPUT_TO_STREAM_VERIFIED);
+    }
     
-    if (outType == GT5X_OUTPUT_TO_BUFFER)
-        outBuf = (uint8_t *)out;
-    else if (outType == GT5X_OUTPUT_TO_STREAM)
-        outStream = (Stream *)out;
-    else
+    return false;
+}
+
+/* Hands the payload to the sink in spans, as it arrives. With hold_tail, the last byte
+   is only written once the checksum has been verified. */
+bool GT5X::read_raw(GT5X_Sink * sink, uint16_t to_read, bool hold_tail) {
+    if (is_busy()) {
+        raw_error = GT5X_BUSY;
         return false;
+    }
     
-    uint16_t rc;
-    
-    if (outType == GT5X_OUTPUT_TO_BUFFER)
-        rc = get_data_response(outBuf, to_read);
-    else if (outType == GT5X_OUTPUT_TO_STREAM)
-        rc = get_data_response(NULL, to_read, outStream);
+    uint16_t rc = get_data_response(sink, to_read, hold_tail);
     
     /* check the length */
     if (rc != to_read) {
-        GT5X_DEBUG_PRINT("Read data failed: ");
-        GT5X_DEBUG_PRINTLN(rc);
+        raw_error = rc;
         return false;
     }
     
+    raw_error = GT5X_OK;
     return true;
 }
 
+/* Why the last read_raw() failed: GT5X_TIMEOUT, GT5X_BAD_CHECKSUM, GT5X_ABORTED or GT5X_BUSY; 
+   GT5X_OK if it didn't */
+uint16_t GT5X::get_raw_error(void) {
+    return raw_error;
+}
+
 uint16_t GT5X::write_raw(uint8_t * data, uint16_t len, bool expect_response) {
-    uint8_t preamble[] = {GT5X_DATA_START_CODE1, GT5X_DATA_START_CODE2, 
-                          (uint8_t)GT5X_DEVICEID, (uint8_t)(GT5X_DEVICEID >> 8)};
+    if (is_busy())
+        return GT5X_BUSY;
+    
+    write_data_packet(data, len);
+    
+    if (!expect_response)
+        return GT5X_OK;
     
-    uint16_t chksum = 0;
-    for (int i = 0; i < sizeof(preamble); i++) {
-        chksum += preamble[i];
+    uint16_t rc = get_cmd_response(NULL);
+    if (rc == GT5X_OK) {
+        if (upload_fid != GT5X_NO_FID && len == GT5X_TEMPLATESZ) {
+            cache_mark(upload_fid, true);
+            if (cache != NULL)
+                cache->put_template(upload_fid, data);
+        }
+        
+        upload_fid = GT5X_NO_FID;
     }
     
+    return rc;
+}
+
+void GT5X::write_data_packet(const uint8_t * data, uint16_t len) {
+    uint16_t chksum = GT5X_DATA_PREAMBLE_SUM;
+    
     for (int i = 0; i < len; i++) {
         chksum += data[i];
     }
     
-    port->write(preamble, sizeof(preamble));
-    port->write(data, len);
-    port->write((uint8_t *)&chksum, 2);
+    /* The preamble and the checksum each go out with some of the data, so a
+       short packet is one write and a long one three, none of them tiny */
+    memcpy(buffer, data_preamble, GT5X_PREAMBLE_LEN);
     
-    if (expect_response) {
-        uint32_t params = 0;
-        uint16_t rc = get_cmd_response(&params);
-        if (rc == GT5X_ACK)
-            return GT5X_OK;
+    if (len + GT5X_FRAME_OVERHEAD <= GT5X_BUFLEN) {
+        memcpy(buffer + GT5X_PREAMBLE_LEN, data, len);
+        buffer[GT5X_PREAMBLE_LEN + len] = (uint8_t)chksum;
+        buffer[GT5X_PREAMBLE_LEN + len + 1] = (uint8_t)(chksum >> 8);
+        port->write(buffer, len + GT5X_FRAME_OVERHEAD);
+    }
+    else {
+        /* leave at least a byte to go with the checksum */
+        uint16_t head = GT5X_BUFLEN - GT5X_PREAMBLE_LEN;
+        if (head > len - 1)
+            head = len - 1;
+        
+        uint16_t tail = len - head;
+        if (tail > GT5X_BUFLEN - 2)
+            tail = GT5X_BUFLEN - 2;
+        
+        memcpy(buffer + GT5X_PREAMBLE_LEN, data, head);
+        port->write(buffer, GT5X_PREAMBLE_LEN + head);
+        
+        if (len - head - tail != 0)
+            port->write(data + head, len - head - tail);
+        
+        memcpy(buffer, data + len - tail, tail);
+        buffer[tail] = (uint8_t)chksum;
+        buffer[tail + 1] = (uint8_t)(chksum >> 8);
+        port->write(buffer, tail + 2);
+    }
+    
+    sent_data = true;
+    GT5X_METRIC(data.link.bytes_out += len + GT5X_FRAME_OVERHEAD);
+    GT5X_TRACE(GT5X_TRACE_DATA_OUT, len, 0);
+}
+
+/* ---------- host-side database mirror ---------- */
+
+void GT5X::attach_cache(GT5X_Cache * c) {
+    cache = c;
+}
+
+void GT5X::cache_mark(uint16_t fid, bool state) {
+    if (cache != NULL && fid != GT5X_NO_FID)
+        cache->mark(fid, state);
+}
+
+/* Fills the attached cache from the module. Stops as soon as every 
+   enrolled ID has been found, so a sparse database syncs quickly. */
+uint16_t GT5X::sync_cache(void) {
+    if (cache == NULL)
+        return GT5X_NACK_INVALID_PARAM;
+    
+    cache->clear();
+    
+    uint32_t total = 0;
+    uint16_t rc = run_command(GT5X_GETENROLLCNT, 0, &total);
+    if (rc != GT5X_OK)
+        return rc;
+    
+    for (uint16_t fid = 0; fid < cache->capacity() && cache->count() < total; fid++) {
+        rc = run_command(GT5X_CHECKENROLLED, fid);
+        if (rc == GT5X_OK)
+            cache->mark(fid, true);
         else if (rc == GT5X_TIMEOUT)
             return rc;
+    }
+    
+    cache->set_valid(true);
+    return GT5X_OK;
+}
+
+/* get_template() + read_raw() into a buffer, served from the cache when it's there */
+uint16_t GT5X::read_template(uint16_t fid, uint8_t * tmpl) {
+    if (cache != NULL) {
+        const uint8_t * cached = cache->get_template(fid);
+        if (cached != NULL) {
+            memcpy(tmpl, cached, GT5X_TEMPLATESZ);
+            return GT5X_OK;
+        }
         
-        return params;
+        /* known to be empty, no need to ask */
+        if (cache->is_valid() && !cache->is_used(fid))
+            return GT5X_NACK_IS_NOT_USED;
     }
     
+    uint16_t rc = get_template(fid);
+    if (rc != GT5X_OK)
+        return rc;
+    
+    if (!read_raw(GT5X_OUTPUT_TO_BUFFER, tmpl, GT5X_TEMPLATESZ))
+        return raw_error;
+    
+    if (cache != NULL)
+        cache->put_template(fid, tmpl);
+    
     return GT5X_OK;
 }
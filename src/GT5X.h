@@ -4,13 +4,35 @@
 #ifndef GT5X_H
 #define GT5X_H
 
-/* uncomment to enable debug output */
+/* uncomment to print a trace of the traffic to Serial, see GT5X_print_trace() */
 //#define GT5X_ENABLE_DEBUG
 
+/* uncomment to call a hook of your own for every trace event, see set_trace_hook() */
+//#define GT5X_ENABLE_TRACE
+
+/* uncomment to keep per-command counters in an attached GT5X_Metrics, see GT5XMetrics.h */
+//#define GT5X_ENABLE_METRICS
+
+#if defined(GT5X_ENABLE_DEBUG) && !defined(GT5X_ENABLE_TRACE)
+#define GT5X_ENABLE_TRACE
+#endif
+
+#if defined(GT5X_ENABLE_TRACE) || defined(GT5X_ENABLE_METRICS)
+#define GT5X_INSTRUMENTED
+#endif
+
+/* scratch space for outgoing frames and incoming spans a sink can't take directly; 
+   smaller saves RAM, larger means fewer, longer reads. At least GT5X_CMD_PACKET_LEN. 
+   Change it here: it sets the size of a GT5X, and GT5X.cpp never sees a sketch's #defines */
 #define GT5X_BUFLEN     32
 
 #define GT5X_TEMPLATESZ         498
 #define GT5X_IMAGESZ            19200   /* 160 x 120 */
+
+/* data packet size while a firmware/ISO CD image is uploaded; the last one is whatever's left */
+#ifndef GT5X_UPGRADE_CHUNKSZ
+#define GT5X_UPGRADE_CHUNKSZ    512
+#endif
  
 /* commands */   
 #define GT5X_OPEN                           0x01    
@@ -79,13 +101,112 @@
 
 #define GT5X_PARAM_CMD_LEN                  6
 
+/* every packet is start code (2), device ID (2), payload, checksum (2) */
+#define GT5X_PREAMBLE_LEN                   4
+#define GT5X_FRAME_OVERHEAD                 (GT5X_PREAMBLE_LEN + 2)
+#define GT5X_CMD_PACKET_LEN                 (GT5X_PARAM_CMD_LEN + GT5X_FRAME_OVERHEAD)
+
+/* what the preamble adds to a packet's checksum, folded in at compile time */
+#define GT5X_CMD_PREAMBLE_SUM               (GT5X_CMD_START_CODE1 + GT5X_CMD_START_CODE2 + \
+                                             (GT5X_DEVICEID & 0xFF) + (GT5X_DEVICEID >> 8))
+#define GT5X_DATA_PREAMBLE_SUM              (GT5X_DATA_START_CODE1 + GT5X_DATA_START_CODE2 + \
+                                             (GT5X_DEVICEID & 0xFF) + (GT5X_DEVICEID >> 8))
+
+#if GT5X_BUFLEN < GT5X_CMD_PACKET_LEN
+#error "GT5X_BUFLEN has to fit a whole command packet"
+#endif
+
+/* Command descriptor flags, see GT5X_command_flags(): the timeout class of the response, 
+ * that of the second response when a data packet is sent after the first one, and 
+ * which way any data packet goes */
+#define GT5X_CMDF_TCLASS                    0x07
+#define GT5X_CMDF_DATA_TCLASS_SHIFT         3
+#define GT5X_CMDF_DATA_IN                   0x40    /* the module sends a data packet after an ACK */
+#define GT5X_CMDF_DATA_OUT                  0x80    /* we send one after an ACK, and get another response */
+
+/* entries in the descriptor table, one per command above */
+#define GT5X_COMMAND_COUNT                  29
+
+/* no template ID */
+#define GT5X_NO_FID                         0xFFFF
+
 /* returned whenever we time out while reading */
 #define GT5X_TIMEOUT                        0xFFFF
 
-/* default uart read timeout */
-#define GT5X_DEFAULT_TIMEOUT                1000
+/* returned by get_result() while an async command is still in flight,
+   and by the blocking methods, which won't cut in on it */
+#define GT5X_BUSY                           0xFFFE
+
+/* a data packet arrived in full but failed its checksum */
+#define GT5X_BAD_CHECKSUM                   0xFFFD
+
+/* a sink refused data mid-transfer */
+#define GT5X_ABORTED                        0xFFFC
+
+/* input that doesn't look like what it should, e.g. a backup with the wrong header */
+#define GT5X_BAD_FORMAT                     0xFFFB
+
+/* Response timeouts, in ms. Each command falls into one of the classes below 
+ * and is given that long to start answering, plus the packet's time on the wire 
+ * at the current baud rate. Override any of them with set_timeout(). */
+enum {
+    GT5X_TCLASS_FAST,       /* everything not listed below, e.g. is_pressed() */
+    GT5X_TCLASS_CAPTURE,    /* capture, GetImage/GetRawImage, MakeTemplate */
+    GT5X_TCLASS_ENROLL,     /* Enroll1-3 */
+    GT5X_TCLASS_VERIFY,     /* 1:1 matches */
+    GT5X_TCLASS_IDENTIFY,   /* 1:N searches, incl. SetTemplate's duplicate check */
+    GT5X_TCLASS_FLASH,      /* deletes and template uploads */
+    GT5X_TCLASS_DATA,       /* the wait for a data packet to begin */
+    GT5X_TCLASS_COUNT
+};
+
+#ifndef GT5X_TIMEOUT_FAST
+#define GT5X_TIMEOUT_FAST                   200
+#endif
+#ifndef GT5X_TIMEOUT_CAPTURE
+#define GT5X_TIMEOUT_CAPTURE                1000
+#endif
+#ifndef GT5X_TIMEOUT_ENROLL
+#define GT5X_TIMEOUT_ENROLL                 1000
+#endif
+#ifndef GT5X_TIMEOUT_VERIFY
+#define GT5X_TIMEOUT_VERIFY                 1000
+#endif
+#ifndef GT5X_TIMEOUT_IDENTIFY
+#define GT5X_TIMEOUT_IDENTIFY               500
+#endif
+#ifndef GT5X_TIMEOUT_FLASH
+#define GT5X_TIMEOUT_FLASH                  3000
+#endif
+#ifndef GT5X_TIMEOUT_DATA
+#define GT5X_TIMEOUT_DATA                   200
+#endif
+
+/* a 1:N search gets this much longer per enrolled ID; the count comes 
+   from the attached cache if it's in sync, else GT5X_MAX_SEARCH_IDS is assumed */
+#define GT5X_IDENTIFY_US_PER_ID             500
+#define GT5X_MAX_SEARCH_IDS                 3000
+
+/* once a packet has started, longest silence allowed before the rest arrives */
+#define GT5X_GAP_TIMEOUT                    100
+
+/* adaptive mode never goes below this */
+#define GT5X_ADAPTIVE_MIN_TIMEOUT           20
+
+/* identify pipeline: gap between presence checks grows by STEP ms 
+   each time no finger is found, up to MAX_INTERVAL ms */
+#define GT5X_POLL_STEP                      10
+#define GT5X_POLL_MAX_INTERVAL              100
+
+/* rates the module accepts for GT5X_CHANGEBAUDRATE, 9600 after power-up */
+#define GT5X_DEFAULT_BAUD                   9600
+#define GT5X_MAX_BAUD                       115200
 
 class Stream;
+class Print;
+class GT5X;
+class GT5X_Cache;
+class GT5X_Metrics;
 
 typedef struct { 
     uint32_t fwversion; 
@@ -93,18 +214,280 @@ typedef struct {
     uint8_t sn[16];
 } GT5X_DeviceInfo;
 
+/* Destination for template/image data. The parser hands over payload 
+ * in contiguous spans as it arrives; write() returns false to abort the transfer. 
+ * Sinks with memory of their own can expose it through acquire(), and the parser 
+ * then reads straight into it (in chunks as large as that memory allows) 
+ * before passing the same span to write(). */
+class GT5X_Sink {
+    public:
+        virtual bool write(const uint8_t * data, uint16_t len) = 0;
+        
+        /* up to *len bytes the parser may read into; NULL to go through GT5X's own buffer */
+        virtual uint8_t * acquire(uint16_t * len) { (void)len; return NULL; }
+};
+
+/* fills a RAM buffer in place */
+class GT5X_BufferSink : public GT5X_Sink {
+    public:
+        GT5X_BufferSink(uint8_t * buf = NULL, uint16_t len = 0);
+        void reset(uint8_t * buf, uint16_t len);
+        
+        bool write(const uint8_t * data, uint16_t len);
+        uint8_t * acquire(uint16_t * len);
+        
+        /* back to the start, for a command response that came in corrupted */
+        void rewind(void);
+        
+        uint16_t count(void) { return pos - base; }
+        
+    private:
+        uint8_t * base;
+        uint8_t * pos;
+        uint8_t * end;
+};
+
+/* forwards to any Arduino Stream (Serial, File...) */
+class GT5X_StreamSink : public GT5X_Sink {
+    public:
+        GT5X_StreamSink(Stream * s);
+        bool write(const uint8_t * data, uint16_t len);
+        
+    private:
+        Stream * stream;
+};
+
+/* Where data to be sent to the module comes from: backups, firmware images... 
+ * read() returns the number of bytes actually read, 0 once there's nothing left. */
+class GT5X_Source {
+    public:
+        virtual uint16_t read(uint8_t * buf, uint16_t len) = 0;
+        
+        /* keeps reading until len bytes are in; false if the source ran dry first */
+        bool read_fully(uint8_t * buf, uint16_t len);
+};
+
+/* reads from RAM (or anything memory-mapped) */
+class GT5X_BufferSource : public GT5X_Source {
+    public:
+        GT5X_BufferSource(const uint8_t * buf, uint32_t len);
+        uint16_t read(uint8_t * buf, uint16_t len);
+        
+    private:
+        const uint8_t * pos;
+        uint32_t left;
+};
+
+/* reads from any Arduino Stream (File, Serial...), subject to its timeout */
+class GT5X_StreamSource : public GT5X_Source {
+    public:
+        GT5X_StreamSource(Stream * s);
+        uint16_t read(uint8_t * buf, uint16_t len);
+        
+    private:
+        Stream * stream;
+};
+
+/* decoder status */
+enum {
+    GT5X_DECODE_BUSY,
+    GT5X_DECODE_DONE,
+    GT5X_DECODE_BAD_CHECKSUM,
+    GT5X_DECODE_ABORTED
+};
+
+/* Resumable parser for a single command response or data packet. 
+ * Bytes can be fed in spans of any size, down to one at a time, 
+ * and the checksum is accumulated as they pass through. Usable on its own 
+ * to parse packets out of an ISR/DMA-filled buffer. */
+class GT5X_Decoder {
+    public:
+        void begin(uint8_t start1, uint8_t start2, uint16_t len, GT5X_Sink * out, bool hold_tail = false);
+        void restart(void);
+        uint16_t feed(const uint8_t * data, uint16_t len);
+        uint16_t wanted(void);
+        uint8_t * payload_buffer(uint16_t * len);
+        uint8_t status(void);
+        
+    private:
+        uint8_t state;
+        uint16_t start_code;
+        uint16_t header;
+        uint16_t field;         /* devid or checksum, as its bytes come in */
+        uint8_t nfield;
+        uint16_t chksum;
+        uint16_t plen;
+        uint16_t remn;
+        GT5X_Sink * sink;
+        bool hold;
+        uint8_t tail;
+        
+#if defined(GT5X_INSTRUMENTED)
+    public:
+        /* packets dropped for a wrong device ID, for GT5X to collect */
+        uint8_t resyncs;
+#endif
+};
+
+/* called once an async command completes; rc is what the equivalent blocking 
+   method would return, param holds the output parameter on GT5X_OK */
+typedef void (*GT5X_Callback)(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+
+/* trace events; a and b as noted */
+enum {
+    GT5X_TRACE_COMMAND,         /* command sent: a = command, b = params */
+    GT5X_TRACE_DATA_OUT,        /* data packet sent: a = payload length */
+    GT5X_TRACE_RESPONSE,        /* a = GT5X_ACK/GT5X_NACK, b = params */
+    GT5X_TRACE_DATA_IN,         /* data packet read in full: a = payload length */
+    GT5X_TRACE_BAD_CHECKSUM,    /* a = 0 for a response, 1 for a data packet */
+    GT5X_TRACE_RESYNC,          /* packets dropped for a wrong device ID: a = how many */
+    GT5X_TRACE_SINK_ABORTED,
+    GT5X_TRACE_TIMEOUT,         /* a = command whose response (or data) never came, b = ms waited */
+    GT5X_TRACE_BAUD             /* a = rate, b = 1 if the link is now at that rate */
+};
+
+typedef void (*GT5X_TraceHook)(GT5X * sensor, uint8_t event, uint32_t a, uint32_t b, void * ctx);
+
+/* descriptor of a command, 0 (a fast one with no data packet) if it's unknown */
+uint8_t GT5X_command_flags(uint16_t cmd);
+
+/* where a command sits in the descriptor table, GT5X_COMMAND_COUNT if it's unknown, 
+   and the other way round; for per-command tables of the caller's */
+uint8_t GT5X_command_index(uint16_t cmd);
+uint16_t GT5X_command_at(uint8_t idx);
+
+#if defined(GT5X_ENABLE_TRACE)
+/* ready-made hook printing one line per event, ctx being the Print to use */
+void GT5X_print_trace(GT5X * sensor, uint8_t event, uint32_t a, uint32_t b, void * ctx);
+#endif
+
+/* The byte link to the module. read() is a batch read of whatever has 
+ * already arrived and never waits; GT5X does its own timing. */
+class GT5X_Transport {
+    public:
+        virtual uint16_t available(void) = 0;
+        virtual uint16_t read(uint8_t * buf, uint16_t len) = 0;
+        virtual void write(const uint8_t * data, uint16_t len) = 0;
+        
+        /* throw away anything received so far */
+        virtual void discard(void);
+};
+
+/* any Arduino Stream, e.g. HardwareSerial or SoftwareSerial */
+class GT5X_StreamTransport : public GT5X_Transport {
+    public:
+        GT5X_StreamTransport(Stream * s);
+        uint16_t available(void);
+        uint16_t read(uint8_t * buf, uint16_t len);
+        void write(const uint8_t * data, uint16_t len);
+        
+    private:
+        Stream * stream;
+};
+
+/* Like GT5X_StreamTransport, but bound to the port's own class, e.g.
+ *
+ *     GT5X_SerialTransport<HardwareSerial> link(Serial1);
+ *     GT5X finger(&link);
+ *
+ * Calls to the port are qualified with S, so each byte is a direct call
+ * into S rather than a trip through Stream's vtable. S has to be the class
+ * that actually implements available() and read(), not Stream itself. */
+template <class S>
+class GT5X_SerialTransport : public GT5X_Transport {
+    public:
+        GT5X_SerialTransport(S & s) : serial(s) {}
+        
+        uint16_t available(void) {
+            int avail = serial.S::available();
+            return (avail > 0) ? avail : 0;
+        }
+        
+        uint16_t read(uint8_t * buf, uint16_t len) {
+            uint16_t avail = available();
+            if (len > avail)
+                len = avail;
+            
+            for (uint16_t i = 0; i < len; i++) {
+                buf[i] = serial.S::read();
+            }
+            return len;
+        }
+        
+        void write(const uint8_t * data, uint16_t len) {
+            serial.S::write(data, len);
+        }
+        
+    private:
+        S & serial;
+};
+
+/* reopens the host side of the link at a new rate, e.g. `fserial.begin(baud)` */
+typedef void (*GT5X_PortConfig)(uint32_t baud, void * ctx);
+
+/* What the blocking methods do while they wait on the module and port has nothing 
+ * pending. It's called again for as long as that lasts, so it can return whenever 
+ * it likes, but shouldn't stay away for more than max_ms, the time left until the wait 
+ * times out. Bytes already received are always parsed first, without calling it. */
+typedef void (*GT5X_WaitHook)(GT5X_Transport * port, uint32_t max_ms, void * ctx);
+
+/* spins; lowest latency, but nothing else gets to run (not on the ESP8266's watchdog) */
+void GT5X_wait_busy(GT5X_Transport * port, uint32_t max_ms, void * ctx);
+
+/* the default: yield() to the scheduler, e.g. the ESP8266/ESP32 system tasks */
+void GT5X_wait_yield(GT5X_Transport * port, uint32_t max_ms, void * ctx);
+
+/* idles the core until the next interrupt: a byte from the UART, or within 1 ms 
+   the millis() tick. AVR and Cortex-M; a short delay() on the ESPs, yield() elsewhere */
+void GT5X_wait_sleep(GT5X_Transport * port, uint32_t max_ms, void * ctx);
+
+/* per-stage timing of the last identify pipeline run, in ms */
+typedef struct {
+    uint32_t wait;          /* start until a finger was seen */
+    uint32_t capture;       /* finger seen until capture succeeded */
+    uint32_t identify;      /* the 1:N search itself */
+    uint32_t total;         /* start to finish, LED on/off included */
+    uint16_t polls;         /* presence checks made */
+    uint16_t captures;      /* capture attempts */
+} GT5X_IdentifyTiming;
+
 /* possible destinations for template/image data read from the module */
 enum {
     GT5X_OUTPUT_TO_STREAM,
-    GT5X_OUTPUT_TO_BUFFER
+    GT5X_OUTPUT_TO_BUFFER,
+    
+    /* like GT5X_OUTPUT_TO_STREAM, but the last byte is held back until the 
+       checksum checks out, so a corrupted payload never reaches the stream in full */
+    GT5X_OUTPUT_TO_STREAM_VERIFIED
 };
 
 class GT5X {
     public:
         GT5X(Stream * ss);
+        
+        /* for a transport of your own, e.g. a GT5X_RingTransport fed from an ISR */
+        GT5X(GT5X_Transport * transport);
         bool begin(GT5X_DeviceInfo * info = NULL);
+        
+        /* finds the module's current rate and moves both ends to the fastest 
+           one up to max_baud, falling back to a slower rate if a switch fails */
+        bool begin(GT5X_DeviceInfo * info, GT5X_PortConfig set_port, void * ctx = NULL, 
+                   uint32_t max_baud = GT5X_MAX_BAUD);
+        uint32_t get_baud_rate(void) { return baud; }
         bool end(void);
         
+        /* base timeout of a GT5X_TCLASS_* class, in ms */
+        void set_timeout(uint8_t tclass, uint16_t ms);
+        uint16_t get_timeout(uint8_t tclass);
+        
+        /* Learn each class's response time as it's observed and time out at 
+           the smoothed latency plus 4 deviations, never later than the base timeout. 
+           A class that times out goes back to its base until it's relearned. */
+        void set_adaptive_timeouts(bool enable);
+        
+        /* GT5X_wait_yield by default, NULL goes back to it */
+        void set_wait_hook(GT5X_WaitHook hook, void * ctx = NULL);
+        
         /* all output params and error codes are within 2 bytes
            so uint16_t is good enough */
         uint16_t set_led(bool state);
@@ -121,23 +504,164 @@ class GT5X {
         uint16_t verify_finger_with_template(uint16_t fid);
         
         uint16_t search_database(uint16_t * fid);
+        
+        /* same as above, but matching a template supplied by the host 
+           instead of a live finger, without storing it first */
+        uint16_t verify_template(uint16_t fid, const uint8_t * tmpl);
+        uint16_t identify_template(const uint8_t * tmpl, uint16_t * fid);
+        bool start_identify_template(const uint8_t * tmpl, GT5X_Callback cb = NULL, void * ctx = NULL);
         uint16_t capture_finger(bool highquality = false);
         
         uint16_t get_template(uint16_t fid);
+        
+        /* template of the last capture, to be read with read_raw() */
+        uint16_t make_template(void);
         uint16_t get_image(void);
         uint16_t set_template(uint16_t fid, uint8_t check_duplicate = true);
         
         bool read_raw(uint8_t outType, void * out, uint16_t to_read);
+        bool read_raw(GT5X_Sink * sink, uint16_t to_read, bool hold_tail = false);
+        uint16_t get_raw_error(void);
         uint16_t write_raw(uint8_t * data, uint16_t len, bool expect_response = false);
         
+        /* non-blocking command interface */
+        bool start_command(uint16_t cmd, uint32_t params, GT5X_Callback cb = NULL, void * ctx = NULL);
+        
+        /* data packet for a command the module has ACKed, e.g. one chunk of a firmware image;
+           data must stay valid until the response comes in */
+        bool start_data(const uint8_t * data, uint16_t len, GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool poll(void);
+        bool is_busy(void);
+        uint16_t get_result(uint32_t * param = NULL);
+        
+        /* one pass of a poll() loop's wait: the wait hook while a response 
+           is due, yield() otherwise */
+        void idle(void);
+        
+        /* presence -> capture -> 1:N search, with the LED handled along the way */
+        bool start_identify(uint32_t wait_ms = 0, bool highquality = false, 
+                            GT5X_Callback cb = NULL, void * ctx = NULL);
+        uint16_t identify_finger(uint16_t * fid, uint32_t wait_ms = 0, bool highquality = false);
+        void get_identify_timing(GT5X_IdentifyTiming * timing);
+        
+        /* optional host-side mirror of the database, see GT5XCache.h */
+        void attach_cache(GT5X_Cache * c);
+        uint16_t sync_cache(void);
+        uint16_t read_template(uint16_t fid, uint8_t * tmpl);
+        GT5X_Cache * get_cache(void) { return cache; }
+        
+#if defined(GT5X_ENABLE_METRICS)
+        void attach_metrics(GT5X_Metrics * m) { metrics = m; }
+#endif
+
+#if defined(GT5X_ENABLE_TRACE)
+        void set_trace_hook(GT5X_TraceHook hook, void * ctx = NULL);
+#endif
+        
     private:
         void write_cmd_packet(uint16_t cmd, uint32_t params);
-        uint16_t get_cmd_response(uint32_t * params);
-        uint16_t get_data_response(uint8_t * data, uint16_t len, Stream * outStream = NULL);
+        void write_data_packet(const uint8_t * data, uint16_t len);
+        uint16_t run_command(uint16_t cmd, uint32_t params, uint32_t * out = NULL);
+        void send_command(uint16_t cmd, uint32_t params, GT5X_Callback cb, void * ctx);
+        void expect_response(GT5X_Callback cb, void * ctx);
+        uint16_t get_cmd_response(uint32_t * out = NULL);
+        uint16_t response_result(uint32_t * out);
+        void reset_cmd_response(void);
+        bool read_cmd_response(void);
+        bool read_packet(void);
+        bool read_timed_out(void);
+        void wait_for_data(void);
+        void init_timeouts(void);
+        void init_hooks(void);
+        void start_read_timer(uint32_t limit);
+        uint8_t timeout_class(void);
+        uint32_t response_timeout(uint8_t tclass);
+        uint32_t wire_time(uint16_t len);
+        void learn_latency(uint8_t tclass, uint32_t ms);
         
-        Stream * port;
-        GT5X_DeviceInfo devinfo;
+        static void pipeline_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        void advance_pipeline(uint16_t rc, uint32_t param);
+        void wait_for_finger(void);
+        void tick_pipeline(void);
+        void finish_pipeline(uint16_t rc, uint32_t fid);
+        void finish_template(uint16_t rc, uint32_t fid);
+        
+        void cache_mark(uint16_t fid, bool state);
+        uint16_t get_data_response(GT5X_Sink * sink, uint16_t len, bool hold_tail = false);
+        uint16_t send_template(uint16_t cmd, uint32_t params, const uint8_t * tmpl, uint32_t * result);
+        
+        uint32_t probe_baud(GT5X_PortConfig set_port, void * ctx, GT5X_DeviceInfo * info, uint32_t max_baud);
+        bool switch_baud(uint32_t rate, GT5X_PortConfig set_port, void * ctx, GT5X_DeviceInfo * info, uint32_t max_baud);
+        void flush_port(void);
+        
+        GT5X_StreamTransport stream_port;
+        GT5X_Transport * port;
         uint8_t buffer[GT5X_BUFLEN];
+        
+        /* packet parser, kept here so it can resume across poll() calls */
+        GT5X_Decoder decoder;
+        uint32_t last_read;
+        uint32_t read_start;
+        uint32_t read_limit;
+        bool read_active;
+        
+        /* what the next response is to, for its timeout */
+        uint16_t sent_cmd;
+        uint32_t sent_params;
+        bool sent_data;
+        
+        uint16_t timeouts[GT5X_TCLASS_COUNT];
+        bool adaptive;
+        GT5X_WaitHook wait_hook;
+        void * wait_ctx;
+        
+        /* smoothed latency and its mean deviation, both in ms x 8; 0 if unlearned */
+        uint16_t srtt[GT5X_TCLASS_COUNT];
+        uint16_t rttvar[GT5X_TCLASS_COUNT];
+        uint8_t resp[GT5X_PARAM_CMD_LEN];
+        GT5X_BufferSink resp_sink;
+        uint32_t resp_params;
+        uint16_t resp_code;
+        uint16_t raw_error;
+        
+        bool pending;
+        GT5X_Callback callback;
+        void * callback_ctx;
+        
+        /* identify pipeline */
+        uint8_t pipe_stage;
+        bool pipe_hq;
+        uint32_t pipe_wait;
+        uint32_t pipe_interval;
+        uint32_t pipe_start;
+        uint32_t pipe_mark;
+        uint16_t pipe_rc;
+        uint32_t pipe_fid;
+        GT5X_Callback pipe_cb;
+        void * pipe_ctx;
+        GT5X_IdentifyTiming pipe_timing;
+        const uint8_t * pipe_tmpl;
+        
+        uint32_t baud;
+        
+        GT5X_Cache * cache;
+        uint16_t enroll_fid;
+        uint16_t upload_fid;
+        
+#if defined(GT5X_INSTRUMENTED)
+        void note_result(uint16_t rc);
+        void note_packet(void);
+        uint32_t sent_at;
+#endif
+
+#if defined(GT5X_ENABLE_METRICS)
+        GT5X_Metrics * metrics;
+#endif
+
+#if defined(GT5X_ENABLE_TRACE)
+        GT5X_TraceHook trace_hook;
+        void * trace_ctx;
+#endif
 };
 
 #endif
@@ -0,0 +1,189 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XBackup.h"
+#include "GT5XCache.h"
+
+#define GT5X_BACKUP_END             0xFFFF
+
+static const uint8_t backup_magic[] = {'G', 'T', '5', 'X'};
+
+/* forwards template bytes to the real sink, summing them on the way */
+class GT5X_SumSink : public GT5X_Sink {
+    public:
+        GT5X_SumSink(GT5X_Sink * s, uint16_t start) : out(s), sum(start) {}
+        
+        bool write(const uint8_t * data, uint16_t len) {
+            for (uint16_t i = 0; i < len; i++) {
+                sum += data[i];
+            }
+            return out->write(data, len);
+        }
+        
+        GT5X_Sink * out;
+        uint16_t sum;
+};
+
+static uint16_t sum_bytes(const uint8_t * data, uint16_t len) {
+    uint16_t sum = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+GT5X_Backup::GT5X_Backup(GT5X * sensor) : finger(sensor)
+{
+    reset();
+}
+
+void GT5X_Backup::reset(void) {
+    memset(&progress, 0, sizeof(progress));
+}
+
+uint16_t GT5X_Backup::export_db(GT5X_Sink * out, uint16_t first, uint16_t last) {
+    GT5X_Cache * cache = finger->get_cache();
+    
+    /* lets us stop early once every template has been found */
+    uint16_t total;
+    uint16_t rc = finger->get_enrolled_count(&total);
+    if (rc != GT5X_OK)
+        return rc;
+    
+    uint8_t header[GT5X_BACKUP_HEADER_SZ] = {backup_magic[0], backup_magic[1], backup_magic[2], backup_magic[3],
+                                             GT5X_BACKUP_VERSION, 0, 
+                                             (uint8_t)GT5X_TEMPLATESZ, (uint8_t)(GT5X_TEMPLATESZ >> 8)};
+    if (!out->write(header, sizeof(header)))
+        return GT5X_ABORTED;
+    
+    uint16_t count = 0;
+    uint16_t file_sum = 0;
+    
+    progress.next_fid = first;
+    
+    for (uint32_t fid = first; fid <= last; fid++) {
+        if (first == 0 && count == total)
+            break;
+        
+        if (cache != NULL && cache->is_valid()) {
+            if (fid >= cache->capacity())
+                break;
+            
+            if (!cache->is_used(fid)) {
+                progress.skipped++;
+                continue;
+            }
+        }
+        
+        rc = finger->get_template(fid);
+        if (rc == GT5X_NACK_IS_NOT_USED) {
+            progress.skipped++;
+            continue;
+        }
+        /* past the end of this module's database */
+        else if (rc == GT5X_NACK_INVALID_POS) {
+            break;
+        }
+        else if (rc != GT5X_OK) {
+            return rc;
+        }
+        
+        uint8_t id[2] = {(uint8_t)fid, (uint8_t)(fid >> 8)};
+        if (!out->write(id, 2))
+            return GT5X_ABORTED;
+        
+        /* straight from the module into the sink */
+        GT5X_SumSink sink(out, id[0] + id[1]);
+        if (!finger->read_raw(&sink, GT5X_TEMPLATESZ))
+            return finger->get_raw_error();
+        
+        uint8_t chk[2] = {(uint8_t)sink.sum, (uint8_t)(sink.sum >> 8)};
+        if (!out->write(chk, 2))
+            return GT5X_ABORTED;
+        
+        file_sum += sink.sum;
+        count++;
+        
+        progress.done++;
+        progress.next_fid = fid + 1;
+    }
+    
+    uint8_t trailer[6] = {(uint8_t)GT5X_BACKUP_END, (uint8_t)(GT5X_BACKUP_END >> 8), 
+                          (uint8_t)count, (uint8_t)(count >> 8), 
+                          (uint8_t)file_sum, (uint8_t)(file_sum >> 8)};
+    if (!out->write(trailer, sizeof(trailer)))
+        return GT5X_ABORTED;
+    
+    return GT5X_OK;
+}
+
+/* Returns GT5X_OK once the whole backup has been restored, GT5X_BAD_FORMAT or 
+   GT5X_BAD_CHECKSUM for a damaged backup, GT5X_TIMEOUT if the source ran dry, 
+   or whatever error the module gave. Records the module refuses as duplicates 
+   are counted in progress.failed and don't stop the import. */
+uint16_t GT5X_Backup::import_db(GT5X_Source * in, uint8_t * work, bool check_duplicate) {
+    uint8_t header[GT5X_BACKUP_HEADER_SZ];
+    if (!in->read_fully(header, sizeof(header)))
+        return GT5X_TIMEOUT;
+    
+    if (memcmp(header, backup_magic, sizeof(backup_magic)) != 0 || header[4] != GT5X_BACKUP_VERSION 
+        || (header[6] | (header[7] << 8)) != GT5X_TEMPLATESZ)
+        return GT5X_BAD_FORMAT;
+    
+    uint16_t count = 0;
+    uint16_t file_sum = 0;
+    
+    while (true) {
+        uint8_t id[2];
+        if (!in->read_fully(id, 2))
+            return GT5X_TIMEOUT;
+        
+        uint16_t fid = id[0] | (id[1] << 8);
+        
+        if (fid == GT5X_BACKUP_END) {
+            uint8_t trailer[4];
+            if (!in->read_fully(trailer, 4))
+                return GT5X_TIMEOUT;
+            
+            if ((trailer[0] | (trailer[1] << 8)) != count || (trailer[2] | (trailer[3] << 8)) != file_sum)
+                return GT5X_BAD_CHECKSUM;
+            
+            return GT5X_OK;
+        }
+        
+        uint8_t chk[2];
+        if (!in->read_fully(work, GT5X_TEMPLATESZ) || !in->read_fully(chk, 2))
+            return GT5X_TIMEOUT;
+        
+        uint16_t sum = id[0] + id[1] + sum_bytes(work, GT5X_TEMPLATESZ);
+        if (sum != (chk[0] | (chk[1] << 8)))
+            return GT5X_BAD_CHECKSUM;
+        
+        count++;
+        file_sum += sum;
+        
+        /* done on a previous run */
+        if (fid < progress.next_fid) {
+            progress.skipped++;
+            continue;
+        }
+        
+        uint16_t rc = finger->set_template(fid, check_duplicate);
+        if (rc == GT5X_OK)
+            rc = finger->write_raw(work, GT5X_TEMPLATESZ, true);
+        
+        /* a duplicate comes back as the ID it duplicates */
+        if (rc < GT5X_OK) {
+            progress.failed++;
+        }
+        else if (rc != GT5X_OK) {
+            return rc;
+        }
+        else {
+            progress.done++;
+        }
+        
+        progress.next_fid = fid + 1;
+    }
+}
@@ -0,0 +1,53 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_BACKUP_H
+#define GT5X_BACKUP_H
+
+#include "GT5X.h"
+
+/* Backup format, all fields little-endian:
+ *
+ *  header:   'G' 'T' '5' 'X', version (1), reserved (1), template size (2)
+ *  record:   ID (2), template (GT5X_TEMPLATESZ), checksum (2)
+ *  trailer:  0xFFFF (2), record count (2), sum of record checksums (2)
+ *
+ * A record's checksum is the 16-bit sum of its ID and template bytes, 
+ * as with the module's own packets. Records are in ascending ID order. */
+ 
+#define GT5X_BACKUP_VERSION         1
+#define GT5X_BACKUP_HEADER_SZ       8
+#define GT5X_BACKUP_RECORD_SZ       (2 + GT5X_TEMPLATESZ + 2)
+
+/* highest ID count of any supported module (GT-521F52) */
+#define GT5X_MAX_IDS                3000
+
+typedef struct {
+    uint16_t next_fid;          /* resume point: IDs below this are done */
+    uint16_t done;              /* templates exported/imported */
+    uint16_t skipped;           /* empty slots or records already imported */
+    uint16_t failed;            /* records the module refused, e.g. duplicates */
+} GT5X_BulkProgress;
+
+/* Walks the database exporting every enrolled template into a sink, 
+ * or restores a backup from a source. Keep `progress` across an interrupted 
+ * import and call import_db() again on the same backup to pick up where it left off. */
+class GT5X_Backup {
+    public:
+        GT5X_Backup(GT5X * sensor);
+        void reset(void);
+        
+        /* IDs first..last inclusive; empty slots are skipped using the 
+           attached cache if there's one */
+        uint16_t export_db(GT5X_Sink * out, uint16_t first = 0, uint16_t last = GT5X_MAX_IDS - 1);
+        
+        /* work must hold GT5X_TEMPLATESZ bytes */
+        uint16_t import_db(GT5X_Source * in, uint8_t * work, bool check_duplicate = false);
+        
+        GT5X_BulkProgress progress;
+        
+    private:
+        GT5X * finger;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XCache.h"
+
+#define GT5X_NO_TAG             0xFFFF
+
+GT5X_Cache::GT5X_Cache(uint8_t * bitmap, uint16_t capacity, 
+                       uint8_t * tmpl_store, uint16_t * tmpl_tags, uint16_t tmpl_slots) :
+    bits(bitmap), cap(capacity), tmpls(tmpl_store), tags(tmpl_tags), nslots(tmpl_slots)
+{
+    if (tmpls == NULL || tags == NULL)
+        nslots = 0;
+    
+    clear();
+    reset_stats();
+}
+
+void GT5X_Cache::clear(void) {
+    memset(bits, 0, GT5X_CACHE_BITMAP_SIZE(cap));
+    used = 0;
+    valid = false;
+    
+    for (uint16_t i = 0; i < nslots; i++) {
+        tags[i] = GT5X_NO_TAG;
+    }
+}
+
+bool GT5X_Cache::is_used(uint16_t fid) {
+    if (fid >= cap)
+        return false;
+    
+    return bits[fid >> 3] & (1 << (fid & 7));
+}
+
+void GT5X_Cache::mark(uint16_t fid, bool state) {
+    if (fid >= cap || is_used(fid) == state)
+        return;
+    
+    if (state) {
+        bits[fid >> 3] |= (1 << (fid & 7));
+        used++;
+    }
+    else {
+        bits[fid >> 3] &= ~(1 << (fid & 7));
+        used--;
+        drop_template(fid);
+    }
+}
+
+uint16_t GT5X_Cache::find_free(uint16_t start) {
+    if (used >= cap)
+        return GT5X_NO_FREE_ID;
+    
+    uint16_t fid = start;
+    while (fid < cap) {
+        /* skip over full bytes 8 IDs at a time */
+        if ((fid & 7) == 0 && bits[fid >> 3] == 0xFF) {
+            fid += 8;
+            continue;
+        }
+        
+        if (!is_used(fid))
+            return fid;
+        
+        fid++;
+    }
+    
+    return GT5X_NO_FREE_ID;
+}
+
+const uint8_t * GT5X_Cache::get_template(uint16_t fid) {
+    if (nslots == 0 || tags[fid % nslots] != fid) {
+        stats.tmpl_misses++;
+        return NULL;
+    }
+    
+    stats.tmpl_hits++;
+    return tmpls + (uint32_t)(fid % nslots) * GT5X_TEMPLATESZ;
+}
+
+void GT5X_Cache::put_template(uint16_t fid, const uint8_t * tmpl) {
+    if (nslots == 0 || fid >= cap)
+        return;
+    
+    uint16_t slot = fid % nslots;
+    memcpy(tmpls + (uint32_t)slot * GT5X_TEMPLATESZ, tmpl, GT5X_TEMPLATESZ);
+    tags[slot] = fid;
+}
+
+void GT5X_Cache::drop_template(uint16_t fid) {
+    if (nslots != 0 && tags[fid % nslots] == fid)
+        tags[fid % nslots] = GT5X_NO_TAG;
+}
+
+void GT5X_Cache::get_stats(GT5X_CacheStats * out) {
+    memcpy(out, &stats, sizeof(GT5X_CacheStats));
+}
+
+void GT5X_Cache::reset_stats(void) {
+    memset(&stats, 0, sizeof(GT5X_CacheStats));
+}
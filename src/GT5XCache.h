@@ -0,0 +1,65 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_CACHE_H
+#define GT5X_CACHE_H
+
+#include "GT5X.h"
+
+#define GT5X_NO_FREE_ID         0xFFFF
+
+/* storage needed for the occupancy bitmap of a module with n IDs */
+#define GT5X_CACHE_BITMAP_SIZE(n)       (((n) + 7) / 8)
+
+typedef struct {
+    uint32_t hits;              /* occupancy queries answered locally */
+    uint32_t misses;            /* ...and those that went to the module */
+    uint32_t tmpl_hits;
+    uint32_t tmpl_misses;
+} GT5X_CacheStats;
+
+/* Host-side mirror of the module's database: an occupancy bitmap, plus 
+ * (optionally) a few cached templates, direct-mapped by ID. All storage 
+ * belongs to the caller. Attach it to a GT5X with attach_cache() and 
+ * fill it once with sync_cache(); after that, enroll/delete/set_template 
+ * calls made through the same GT5X keep it up to date. */
+class GT5X_Cache {
+    public:
+        GT5X_Cache(uint8_t * bitmap, uint16_t capacity, 
+                   uint8_t * tmpl_store = NULL, uint16_t * tmpl_tags = NULL, uint16_t tmpl_slots = 0);
+        
+        void clear(void);
+        bool is_valid(void) { return valid; }
+        void set_valid(bool state) { valid = state; }
+        
+        uint16_t capacity(void) { return cap; }
+        uint16_t count(void) { return used; }
+        bool is_used(uint16_t fid);
+        void mark(uint16_t fid, bool state);
+        
+        /* lowest unused ID at or after start, GT5X_NO_FREE_ID if the database is full */
+        uint16_t find_free(uint16_t start = 0);
+        
+        const uint8_t * get_template(uint16_t fid);
+        void put_template(uint16_t fid, const uint8_t * tmpl);
+        void drop_template(uint16_t fid);
+        
+        void get_stats(GT5X_CacheStats * out);
+        void reset_stats(void);
+        
+    private:
+        friend class GT5X;
+        
+        uint8_t * bits;
+        uint16_t cap;
+        uint16_t used;
+        bool valid;
+        
+        uint8_t * tmpls;
+        uint16_t * tags;
+        uint16_t nslots;
+        
+        GT5X_CacheStats stats;
+};
+
+#endif
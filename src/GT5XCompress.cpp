@@ -0,0 +1,86 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XCompress.h"
+
+GT5X_RLESink::GT5X_RLESink(GT5X_Sink * dest, uint32_t total) : out(dest)
+{
+    reset(total);
+}
+
+void GT5X_RLESink::reset(uint32_t n) {
+    total = n;
+    seen = 0;
+    written = 0;
+    prev = 0;
+    run_len = 0;
+    lit_len = 0;
+}
+
+bool GT5X_RLESink::write(const uint8_t * data, uint16_t len) {
+    for (uint16_t i = 0; i < len; i++) {
+        if (!put(data[i] - prev))
+            return false;
+        prev = data[i];
+    }
+    
+    seen += len;
+    if (seen >= total)
+        return end_run() && flush_literals();
+    
+    return true;
+}
+
+/* extend the current run, or close it and start another */
+bool GT5X_RLESink::put(uint8_t delta) {
+    if (run_len != 0 && delta == run_val && run_len < GT5X_RLE_MAX_RUN) {
+        run_len++;
+        return true;
+    }
+    
+    if (!end_run())
+        return false;
+    
+    run_val = delta;
+    run_len = 1;
+    return true;
+}
+
+/* a run too short to pay for its control byte joins the literals */
+bool GT5X_RLESink::end_run(void) {
+    if (run_len >= GT5X_RLE_MIN_RUN) {
+        if (!flush_literals())
+            return false;
+        
+        uint8_t pkt[2] = {(uint8_t)(0x80 + run_len - GT5X_RLE_MIN_RUN), run_val};
+        run_len = 0;
+        return emit(pkt, 2);
+    }
+    
+    while (run_len != 0) {
+        if (lit_len == GT5X_RLE_MAX_LITERAL && !flush_literals())
+            return false;
+        
+        lit[lit_len++] = run_val;
+        run_len--;
+    }
+    
+    return true;
+}
+
+bool GT5X_RLESink::flush_literals(void) {
+    if (lit_len == 0)
+        return true;
+    
+    uint8_t ctrl = lit_len - 1;
+    uint8_t n = lit_len;
+    lit_len = 0;
+    
+    return emit(&ctrl, 1) && emit(lit, n);
+}
+
+bool GT5X_RLESink::emit(const uint8_t * data, uint16_t len) {
+    written += len;
+    return out->write(data, len);
+}
@@ -0,0 +1,57 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_COMPRESS_H
+#define GT5X_COMPRESS_H
+
+#include "GT5X.h"
+
+/* Delta + run-length coding for images, done on the fly between the 
+ * packet parser and a slow output such as Serial.
+ *
+ * Each pixel becomes its difference from the one before (mod 256, the first 
+ * against 0), so flat background turns into runs of zeros. The deltas are then 
+ * packed into runs and literals, each led by a control byte c:
+ *
+ *  c < 0x80:   c + 1 literal deltas follow
+ *  c >= 0x80:  the next delta repeats c - 0x80 + GT5X_RLE_MIN_RUN times
+ *
+ * The decoder knows the pixel count up front, so there's no end marker. */
+ 
+#define GT5X_RLE_MAX_LITERAL        128
+#define GT5X_RLE_MIN_RUN            3
+#define GT5X_RLE_MAX_RUN            (0x7F + GT5X_RLE_MIN_RUN)
+
+/* marker the image_to_pc sketch sends before a compressed image, instead of '\t' */
+#define GT5X_RLE_STREAM_START       '\v'
+
+class GT5X_RLESink : public GT5X_Sink {
+    public:
+        /* total: pixels in the image, everything is flushed once they're all in */
+        GT5X_RLESink(GT5X_Sink * out, uint32_t total);
+        void reset(uint32_t total);
+        
+        bool write(const uint8_t * data, uint16_t len);
+        
+        uint32_t bytes_in(void) { return seen; }
+        uint32_t bytes_out(void) { return written; }
+        
+    private:
+        bool put(uint8_t delta);
+        bool end_run(void);
+        bool flush_literals(void);
+        bool emit(const uint8_t * data, uint16_t len);
+        
+        GT5X_Sink * out;
+        uint32_t total;
+        uint32_t seen;
+        uint32_t written;
+        uint8_t prev;
+        
+        uint8_t run_val;
+        uint8_t run_len;
+        uint8_t lit[GT5X_RLE_MAX_LITERAL];
+        uint8_t lit_len;
+};
+
+#endif
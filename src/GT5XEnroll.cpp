@@ -0,0 +1,316 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XEnroll.h"
+#include "GT5XCache.h"
+
+GT5X_Enroller::GT5X_Enroller(GT5X * sensor) : finger(sensor), sink(NULL), wait_ms(0), check_dups(true),
+    fids(NULL), nfids(0), single(GT5X_NO_FID), cb(NULL), cb_ctx(NULL), stage(GT5X_ENROLL_IDLE), fid(GT5X_NO_FID), 
+    pass(0), attempts(0), cancelled(false), result(GT5X_OK), pass_start(0), mark(0), interval(0)
+{
+    memset(&progress, 0, sizeof(progress));
+}
+
+bool GT5X_Enroller::start_batch(const uint16_t * ids, uint16_t count, GT5X_Callback callback, void * ctx) {
+    if (is_busy() || finger->is_busy() || count == 0)
+        return false;
+    
+    fids = ids;
+    nfids = count;
+    cb = callback;
+    cb_ctx = ctx;
+    cancelled = false;
+    memset(&progress, 0, sizeof(progress));
+    
+    /* what's left if it's cancelled before the first ID is up */
+    result = GT5X_NACK_CAPTURE_CANCELED;
+    
+    /* the LED stays on for the whole batch */
+    return send(GT5X_ENROLL_LED_ON, GT5X_CMOSLED, 1);
+}
+
+bool GT5X_Enroller::start(uint16_t id, GT5X_Callback callback, void * ctx) {
+    single = id;
+    return start_batch(&single, 1, callback, ctx);
+}
+
+uint16_t GT5X_Enroller::enroll(uint16_t id) {
+    if (!start(id))
+        return GT5X_BUSY;
+    
+    while (poll()) {
+        finger->idle();
+    }
+    
+    return result;
+}
+
+uint8_t GT5X_Enroller::prompt(void) {
+    switch (stage) {
+        case GT5X_ENROLL_PRESENCE:
+        case GT5X_ENROLL_WAIT:
+        case GT5X_ENROLL_CAPTURE:
+            return GT5X_PROMPT_PLACE;
+        case GT5X_ENROLL_LIFT:
+        case GT5X_ENROLL_LIFT_WAIT:
+            return GT5X_PROMPT_LIFT;
+        default:
+            return GT5X_PROMPT_NONE;
+    }
+}
+
+/* Returns true while the batch is still going */
+bool GT5X_Enroller::poll(void) {
+    if (stage == GT5X_ENROLL_WAIT || stage == GT5X_ENROLL_LIFT_WAIT) {
+        if ((uint32_t)(millis() - mark) >= interval) {
+            interval += GT5X_POLL_STEP;
+            if (interval > GT5X_POLL_MAX_INTERVAL)
+                interval = GT5X_POLL_MAX_INTERVAL;
+            
+            if (stage == GT5X_ENROLL_WAIT)
+                send(GT5X_ENROLL_PRESENCE, GT5X_ISPRESSFINGER, 0);
+            else
+                send(GT5X_ENROLL_LIFT, GT5X_ISPRESSFINGER, 0);
+        }
+    }
+    else {
+        finger->poll();
+    }
+    
+    return is_busy();
+}
+
+bool GT5X_Enroller::send(uint8_t next, uint16_t cmd, uint32_t params) {
+    stage = next;
+    if (finger->start_command(cmd, params, on_step, this))
+        return true;
+    
+    /* somebody else is using the sensor */
+    stage = GT5X_ENROLL_IDLE;
+    result = GT5X_BUSY;
+    if (cb != NULL)
+        cb(finger, GT5X_BUSY, fid, cb_ctx);
+    return false;
+}
+
+void GT5X_Enroller::on_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    (void)sensor;
+    ((GT5X_Enroller *)ctx)->advance(rc, param);
+}
+
+/* ID already taken according to the cache: no need to ask the module */
+void GT5X_Enroller::begin_person(void) {
+    fid = fids[progress.next];
+    pass = 1;
+    attempts = 0;
+    
+    GT5X_Cache * cache = finger->get_cache();
+    if (cache != NULL && cache->is_valid() && cache->is_used(fid)) {
+        result = GT5X_NACK_IS_ALREADY_USED;
+        progress.failed++;
+        if (cb != NULL)
+            cb(finger, result, fid, cb_ctx);
+        next_person();
+        return;
+    }
+    
+    send(GT5X_ENROLL_START, GT5X_STARTENROLL, fid);
+}
+
+void GT5X_Enroller::wait_for_finger(void) {
+    if (wait_ms != 0 && (uint32_t)(millis() - pass_start) >= wait_ms) {
+        finish_person(GT5X_NACK_FINGER_IS_NOT_PRESSED);
+        return;
+    }
+    
+    stage = GT5X_ENROLL_WAIT;
+    mark = millis();
+}
+
+/* report, then make sure the finger is off the sensor before anybody goes next */
+void GT5X_Enroller::finish_person(uint16_t rc) {
+    result = rc;
+    
+    if (rc == GT5X_OK)
+        progress.enrolled++;
+    else if (rc < GT5X_OK)
+        progress.duplicates++;
+    else
+        progress.failed++;
+    
+    if (cb != NULL)
+        cb(finger, rc, fid, cb_ctx);
+    
+    pass = 0;
+    interval = 0;
+    send(GT5X_ENROLL_LIFT, GT5X_ISPRESSFINGER, 0);
+}
+
+void GT5X_Enroller::next_person(void) {
+    progress.next++;
+    
+    if (progress.next < nfids && !cancelled)
+        begin_person();
+    else
+        send(GT5X_ENROLL_LED_OFF, GT5X_CMOSLED, 0);
+}
+
+void GT5X_Enroller::advance(uint16_t rc, uint32_t param) {
+    if (cancelled && stage != GT5X_ENROLL_LED_OFF) {
+        if (stage != GT5X_ENROLL_LED_ON)
+            result = GT5X_NACK_CAPTURE_CANCELED;
+        send(GT5X_ENROLL_LED_OFF, GT5X_CMOSLED, 0);
+        return;
+    }
+    
+    switch (stage) {
+        case GT5X_ENROLL_LED_ON:
+            if (rc != GT5X_OK) {
+                result = rc;
+                if (cb != NULL)
+                    cb(finger, rc, fids[0], cb_ctx);
+                send(GT5X_ENROLL_LED_OFF, GT5X_CMOSLED, 0);
+                return;
+            }
+            
+            progress.next = 0;
+            begin_person();
+            return;
+        case GT5X_ENROLL_START:
+            if (rc != GT5X_OK) {
+                finish_person(rc);
+                return;
+            }
+            
+            pass_start = millis();
+            interval = 0;
+            send(GT5X_ENROLL_PRESENCE, GT5X_ISPRESSFINGER, 0);
+            return;
+        case GT5X_ENROLL_PRESENCE:
+            if (rc != GT5X_OK) {
+                finish_person(rc);
+                return;
+            }
+            
+            /* 0 means a finger is down */
+            if (param == 0) {
+                send(GT5X_ENROLL_CAPTURE, GT5X_CAPTUREFINGER, 1);
+                return;
+            }
+            
+            wait_for_finger();
+            return;
+        case GT5X_ENROLL_CAPTURE: {
+            if (rc == GT5X_NACK_FINGER_IS_NOT_PRESSED || rc == GT5X_NACK_BAD_FINGER) {
+                interval = 0;
+                wait_for_finger();
+                return;
+            }
+            else if (rc != GT5X_OK) {
+                finish_person(rc);
+                return;
+            }
+            
+            /* an empty database can't hold a duplicate, and a retry's been checked already */
+            GT5X_Cache * cache = finger->get_cache();
+            bool empty = (cache != NULL && cache->is_valid() && cache->count() == 0);
+            
+            if (pass == 1 && attempts == 0 && check_dups && !empty)
+                send(GT5X_ENROLL_DUP_CHECK, GT5X_IDENTIFY1_N, 0);
+            else
+                send(GT5X_ENROLL_SCAN, GT5X_ENROLL1 + pass - 1, 0);
+            return;
+        }
+        case GT5X_ENROLL_DUP_CHECK:
+            if (rc == GT5X_OK) {
+                finish_person(param);
+                return;
+            }
+            else if (rc != GT5X_NACK_IDENTIFY_FAILED && rc != GT5X_NACK_DB_IS_EMPTY) {
+                finish_person(rc);
+                return;
+            }
+            
+            send(GT5X_ENROLL_SCAN, GT5X_ENROLL1, 0);
+            return;
+        case GT5X_ENROLL_SCAN:
+            /* the module gave up on this enrollment, have them lift and start over */
+            if ((rc == GT5X_NACK_ENROLL_FAILED || rc == GT5X_NACK_BAD_FINGER) 
+                && ++attempts < GT5X_ENROLL_ATTEMPTS) {
+                pass = 1;
+                interval = 0;
+                send(GT5X_ENROLL_LIFT, GT5X_ISPRESSFINGER, 0);
+                return;
+            }
+            else if (rc != GT5X_OK) {
+                finish_person(rc);
+                return;
+            }
+            
+            if (pass < 3) {
+                pass++;
+                interval = 0;
+                send(GT5X_ENROLL_LIFT, GT5X_ISPRESSFINGER, 0);
+                return;
+            }
+            
+            /* enroll_scan() would have done this for us */
+            if (finger->get_cache() != NULL)
+                finger->get_cache()->mark(fid, true);
+            
+            if (sink != NULL) {
+                send(GT5X_ENROLL_GET_TEMPLATE, GT5X_GETTEMPLATE, fid);
+                return;
+            }
+            
+            finish_person(GT5X_OK);
+            return;
+        case GT5X_ENROLL_GET_TEMPLATE:
+            if (rc != GT5X_OK) {
+                finish_person(rc);
+                return;
+            }
+            
+            /* the one blocking step, about 45ms at 115200 */
+            finish_person(finger->read_raw(sink, GT5X_TEMPLATESZ) ? GT5X_OK : finger->get_raw_error());
+            return;
+        case GT5X_ENROLL_LIFT:
+            if (rc != GT5X_OK) {
+                /* the result's in already if this was the end of a person */
+                if (pass == 0)
+                    next_person();
+                else
+                    finish_person(rc);
+                return;
+            }
+            
+            /* still pressed */
+            if (param == 0) {
+                stage = GT5X_ENROLL_LIFT_WAIT;
+                mark = millis();
+                return;
+            }
+            
+            if (pass == 0) {
+                next_person();
+                return;
+            }
+            
+            /* only a retry lifts before the second pass */
+            if (pass == 1) {
+                send(GT5X_ENROLL_START, GT5X_STARTENROLL, fid);
+                return;
+            }
+            
+            pass_start = millis();
+            interval = 0;
+            send(GT5X_ENROLL_PRESENCE, GT5X_ISPRESSFINGER, 0);
+            return;
+        case GT5X_ENROLL_LED_OFF:
+            stage = GT5X_ENROLL_IDLE;
+            return;
+        default:
+            return;
+    }
+}
@@ -0,0 +1,116 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_ENROLL_H
+#define GT5X_ENROLL_H
+
+#include "GT5X.h"
+
+/* times a person may start over after a mismatched or smudged pass */
+#ifndef GT5X_ENROLL_ATTEMPTS
+#define GT5X_ENROLL_ATTEMPTS        3
+#endif
+
+/* what the person at the sensor should be doing, see prompt() */
+enum {
+    GT5X_PROMPT_NONE,
+    GT5X_PROMPT_PLACE,
+    GT5X_PROMPT_LIFT
+};
+
+typedef struct {
+    uint16_t enrolled;
+    uint16_t duplicates;        /* fingers already enrolled under another ID */
+    uint16_t failed;            /* everything else, incl. IDs already in use */
+    uint16_t next;              /* index of the next ID in the batch */
+} GT5X_EnrollProgress;
+
+/* Non-blocking enrollment session: for each ID in a batch, StartEnroll and 
+ * the three capture + Enroll passes, waiting for the finger to be lifted 
+ * and put back in between. The first capture is checked against the database 
+ * (skipped while the attached cache says it's empty) so a duplicate is caught 
+ * after one touch instead of three. Once enrolled, the template can go 
+ * straight out through a sink while the person lifts their finger.
+ * 
+ * cb is called once per ID with rc as for enroll_scan(): GT5X_OK, a NACK code, 
+ * or the ID of the duplicate if the finger is already enrolled; param is the ID. 
+ * If the download to the sink fails, rc is get_raw_error()'s and the ID 
+ * stays enrolled on the module. */
+class GT5X_Enroller {
+    public:
+        GT5X_Enroller(GT5X * sensor);
+        
+        /* NULL to leave templates on the module only */
+        void set_sink(GT5X_Sink * out) { sink = out; }
+        
+        /* longest wait for a finger on each pass, 0 for no limit */
+        void set_wait(uint32_t ms) { wait_ms = ms; }
+        void set_duplicate_check(bool state) { check_dups = state; }
+        
+        /* fids must stay valid until the batch is done */
+        bool start_batch(const uint16_t * fids, uint16_t count, GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool start(uint16_t fid, GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool poll(void);
+        bool is_busy(void) { return stage != GT5X_ENROLL_IDLE; }
+        
+        /* stops once the command in flight completes */
+        void cancel(void) { cancelled = true; }
+        
+        /* blocking, single ID */
+        uint16_t enroll(uint16_t fid);
+        
+        uint16_t current_fid(void) { return fid; }
+        uint8_t current_pass(void) { return pass; }
+        uint8_t prompt(void);
+        
+        GT5X_EnrollProgress progress;
+        
+    private:
+        enum {
+            GT5X_ENROLL_IDLE,
+            GT5X_ENROLL_LED_ON,
+            GT5X_ENROLL_START,
+            GT5X_ENROLL_PRESENCE,
+            GT5X_ENROLL_WAIT,
+            GT5X_ENROLL_CAPTURE,
+            GT5X_ENROLL_DUP_CHECK,
+            GT5X_ENROLL_SCAN,
+            GT5X_ENROLL_GET_TEMPLATE,
+            GT5X_ENROLL_LIFT,
+            GT5X_ENROLL_LIFT_WAIT,
+            GT5X_ENROLL_LED_OFF
+        };
+        
+        static void on_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        void advance(uint16_t rc, uint32_t param);
+        bool send(uint8_t next, uint16_t cmd, uint32_t params);
+        void begin_person(void);
+        void wait_for_finger(void);
+        void finish_person(uint16_t rc);
+        void next_person(void);
+        
+        GT5X * finger;
+        GT5X_Sink * sink;
+        uint32_t wait_ms;
+        bool check_dups;
+        
+        const uint16_t * fids;
+        uint16_t nfids;
+        uint16_t single;
+        GT5X_Callback cb;
+        void * cb_ctx;
+        
+        uint8_t stage;
+        uint16_t fid;
+        uint8_t pass;
+        uint8_t attempts;
+        bool cancelled;
+        uint16_t result;
+        
+        /* presence polling, backing off like the identify pipeline */
+        uint32_t pass_start;
+        uint32_t mark;
+        uint32_t interval;
+};
+
+#endif
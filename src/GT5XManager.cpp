@@ -0,0 +1,218 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XManager.h"
+
+GT5X_Manager::GT5X_Manager(void) : nsensors(0)
+{
+    
+}
+
+uint8_t GT5X_Manager::add(GT5X * sensor) {
+    if (nsensors >= GT5X_MAX_SENSORS)
+        return GT5X_NO_SENSOR;
+    
+    Slot * slot = &slots[nsensors];
+    memset(slot, 0, sizeof(Slot));
+    slot->sensor = sensor;
+    
+    return nsensors++;
+}
+
+bool GT5X_Manager::submit(uint8_t idx, uint16_t cmd, uint32_t params, GT5X_Callback cb, void * ctx) {
+    if (idx >= nsensors)
+        return false;
+    
+    Slot * slot = &slots[idx];
+    if (slot->len > GT5X_QUEUE_DEPTH) {
+        slot->stats.rejected++;
+        return false;
+    }
+    
+    Job * job = &slot->jobs[(slot->head + slot->len) % (GT5X_QUEUE_DEPTH + 1)];
+    job->cmd = cmd;
+    job->params = params;
+    job->cb = cb;
+    job->ctx = ctx;
+    job->submitted = millis();
+    
+    slot->len++;
+    if (slot->len > slot->stats.max_queued)
+        slot->stats.max_queued = slot->len;
+    
+    /* idle sensor, get going right away */
+    if (!slot->started)
+        start_next(slot);
+    
+    return true;
+}
+
+void GT5X_Manager::start_next(Slot * slot) {
+    if (slot->len == 0 || slot->following)
+        return;
+    
+    /* fails only if someone else is using the sensor directly, try again on the next poll */
+    Job * job = &slot->jobs[slot->head];
+    if (!slot->sensor->start_command(job->cmd, job->params, on_complete, slot)) {
+        stall(slot);
+        return;
+    }
+    
+    slot->started = true;
+    slot->started_at = millis();
+    
+    if (slot->stalled) {
+        slot->stats.stall_us += micros() - slot->stalled_at;
+        slot->stalled = false;
+    }
+}
+
+/* work is waiting and nothing's in flight, the clock starts now */
+void GT5X_Manager::stall(Slot * slot) {
+    if (!slot->stalled) {
+        slot->stalled = true;
+        slot->stalled_at = micros();
+    }
+}
+
+/* whether a data packet follows the response, to be read or sent by the callback */
+static bool has_data_phase(uint16_t cmd, uint32_t params, uint16_t rc) {
+    if (rc != GT5X_OK)
+        return false;
+    
+    /* OPEN only sends the device info when asked to */
+    if (cmd == GT5X_OPEN)
+        return params != 0;
+    
+    return (GT5X_command_flags(cmd) & (GT5X_CMDF_DATA_IN | GT5X_CMDF_DATA_OUT)) != 0;
+}
+
+/* trampoline for every sensor: account for the job, then hand over to the caller's callback */
+void GT5X_Manager::on_complete(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    Slot * slot = (Slot *)ctx;
+    Job job = slot->jobs[slot->head];
+    
+    slot->head = (slot->head + 1) % (GT5X_QUEUE_DEPTH + 1);
+    slot->len--;
+    
+    GT5X_SensorStats * st = &slot->stats;
+    uint32_t now = millis();
+    uint32_t latency = now - job.submitted;
+    
+    st->busy_ms += now - slot->started_at;
+    st->completed++;
+    st->last_latency = latency;
+    st->total_latency += latency;
+    if (latency > st->max_latency)
+        st->max_latency = latency;
+    if (rc == GT5X_TIMEOUT)
+        st->timeouts++;
+    
+    /* this may well submit more work, which waits behind what's queued 
+       since the slot still counts as started */
+    if (job.cb != NULL)
+        job.cb(sensor, rc, param, job.ctx);
+    
+    /* the packet kept the link busy as much as the command did */
+    if (has_data_phase(job.cmd, job.params, rc))
+        st->busy_ms += millis() - now;
+    
+    slot->started = false;
+    
+    /* a callback that handed the packet to start_data() holds up the queue 
+       until poll() has seen the exchange through */
+    if (sensor->is_busy()) {
+        slot->following = true;
+        slot->started_at = millis();
+        return;
+    }
+    
+    start_next(slot);
+}
+
+uint16_t GT5X_Manager::poll(void) {
+    uint16_t outstanding = 0;
+    
+    for (uint8_t i = 0; i < nsensors; i++) {
+        Slot * slot = &slots[i];
+        
+        if (slot->following) {
+            if (slot->sensor->poll()) {
+                outstanding += slot->len + 1;
+                continue;
+            }
+            
+            slot->following = false;
+            slot->stats.busy_ms += millis() - slot->started_at;
+        }
+        
+        if (!slot->started)
+            start_next(slot);
+        
+        if (slot->started)
+            slot->sensor->poll();
+        
+        /* keep the wire busy: start the next one as soon as the last completes */
+        if (!slot->started)
+            start_next(slot);
+        
+        outstanding += slot->len;
+    }
+    
+    return outstanding;
+}
+
+/* With one sensor busy its wait hook gets the time. With more, waiting on 
+   any of them could hold up the others, so it's only a yield() */
+void GT5X_Manager::idle(void) {
+    GT5X * busy = NULL;
+    
+    for (uint8_t i = 0; i < nsensors; i++) {
+        if (!slots[i].sensor->is_busy())
+            continue;
+        
+        if (busy != NULL) {
+            yield();
+            return;
+        }
+        busy = slots[i].sensor;
+    }
+    
+    if (busy != NULL)
+        busy->idle();
+    else
+        yield();
+}
+
+uint8_t GT5X_Manager::queue_depth(uint8_t idx) {
+    return (idx < nsensors) ? slots[idx].len : 0;
+}
+
+bool GT5X_Manager::get_stats(uint8_t idx, GT5X_SensorStats * stats) {
+    if (idx >= nsensors)
+        return false;
+    
+    memcpy(stats, &slots[idx].stats, sizeof(GT5X_SensorStats));
+    stats->queued = slots[idx].len;
+    return true;
+}
+
+uint8_t GT5X_Manager::utilisation(uint8_t idx) {
+    if (idx >= nsensors)
+        return 0;
+    
+    /* by the ms is plenty, and keeps the sums from overflowing */
+    uint32_t busy = slots[idx].stats.busy_ms;
+    uint32_t total = busy + slots[idx].stats.stall_us / 1000;
+    if (total == 0)
+        return 100;
+    
+    return (total < 0x1000000UL) ? (busy * 100) / total : busy / (total / 100);
+}
+
+void GT5X_Manager::reset_stats(void) {
+    for (uint8_t i = 0; i < nsensors; i++) {
+        memset(&slots[i].stats, 0, sizeof(GT5X_SensorStats));
+    }
+}
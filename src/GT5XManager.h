@@ -0,0 +1,97 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_MANAGER_H
+#define GT5X_MANAGER_H
+
+#include "GT5X.h"
+
+/* Both of these size a GT5X_Manager, so change them here rather than 
+   with a #define in the sketch, which GT5XManager.cpp would never see */
+
+/* max number of sensors a single manager drives */
+#define GT5X_MAX_SENSORS        4
+
+/* commands that can wait behind the one in flight, per sensor */
+#define GT5X_QUEUE_DEPTH        4
+
+#define GT5X_NO_SENSOR          0xFF
+
+typedef struct {
+    uint8_t queued;             /* waiting + in flight */
+    uint8_t max_queued;
+    uint32_t completed;
+    uint32_t timeouts;
+    uint32_t rejected;          /* submitted while the queue was full */
+    uint32_t last_latency;      /* ms from submit() to completion */
+    uint32_t max_latency;
+    uint32_t total_latency;
+    uint32_t busy_ms;           /* time with a command in flight */
+    uint32_t stall_us;          /* time with commands queued but none in flight */
+} GT5X_SensorStats;
+
+/* Drives several GT5X modules, each on its own port, from one main loop. 
+ * Commands are queued per sensor and started with the async interface, 
+ * so a slow identify on one sensor never holds up the others.
+ * 
+ * The next queued command is sent once the last one's callback has returned, 
+ * so a callback can deal with a data packet that follows the response 
+ * (get_image, get_template, set_template...) there and then, or hand it to 
+ * GT5X::start_data(), which poll() then sees through before moving on. 
+ * Anything it submits goes to the back of the queue. */
+class GT5X_Manager {
+    public:
+        GT5X_Manager(void);
+        
+        /* returns the sensor's index, or GT5X_NO_SENSOR if full */
+        uint8_t add(GT5X * sensor);
+        uint8_t count(void) { return nsensors; }
+        GT5X * sensor(uint8_t idx) { return (idx < nsensors) ? slots[idx].sensor : NULL; }
+        
+        /* queue a command; cb gets the same arguments as with GT5X::start_command() */
+        bool submit(uint8_t idx, uint16_t cmd, uint32_t params, GT5X_Callback cb = NULL, void * ctx = NULL);
+        
+        /* advance every sensor; returns the number of commands still outstanding */
+        uint16_t poll(void);
+        
+        /* between polls in a blocking loop, in place of GT5X::idle() */
+        void idle(void);
+        
+        uint8_t queue_depth(uint8_t idx);
+        bool get_stats(uint8_t idx, GT5X_SensorStats * stats);
+        
+        /* percentage of the time there was work queued that a command was actually in flight */
+        uint8_t utilisation(uint8_t idx);
+        void reset_stats(void);
+        
+    private:
+        typedef struct {
+            uint16_t cmd;
+            uint32_t params;
+            GT5X_Callback cb;
+            void * ctx;
+            uint32_t submitted;
+        } Job;
+        
+        typedef struct {
+            GT5X * sensor;
+            Job jobs[GT5X_QUEUE_DEPTH + 1];     /* [head] is in flight once started */
+            uint8_t head;
+            uint8_t len;
+            bool started;
+            bool following;             /* the callback's own exchange is in flight */
+            bool stalled;
+            uint32_t started_at;        /* millis() */
+            uint32_t stalled_at;        /* micros() */
+            GT5X_SensorStats stats;
+        } Slot;
+        
+        static void on_complete(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        static void start_next(Slot * slot);
+        static void stall(Slot * slot);
+        
+        Slot slots[GT5X_MAX_SENSORS];
+        uint8_t nsensors;
+};
+
+#endif
@@ -0,0 +1,128 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XMetrics.h"
+
+GT5X_Metrics::GT5X_Metrics()
+{
+    reset();
+}
+
+void GT5X_Metrics::reset(void) {
+    memset(&data, 0, sizeof(data));
+    
+    for (uint8_t i = 0; i < GT5X_METRICS_OPS; i++) {
+        data.ops[i].cmd = GT5X_command_at(i);
+        data.ops[i].min_ms = 0xFFFF;
+    }
+}
+
+void GT5X_Metrics::snapshot(GT5X_MetricsData * out) {
+    memcpy(out, &data, sizeof(data));
+}
+
+GT5X_OpStats * GT5X_Metrics::find(uint16_t cmd) {
+    uint8_t idx = GT5X_command_index(cmd);
+    return (idx < GT5X_METRICS_OPS) ? &data.ops[idx] : NULL;
+}
+
+const GT5X_OpStats * GT5X_Metrics::get_op(uint16_t cmd) {
+    return find(cmd);
+}
+
+void GT5X_Metrics::record_call(uint16_t cmd) {
+    GT5X_OpStats * op = find(cmd);
+    if (op != NULL)
+        op->calls++;
+}
+
+/* rc is GT5X_OK, GT5X_TIMEOUT or what the module NACKed with */
+void GT5X_Metrics::record_result(uint16_t cmd, uint16_t rc, uint32_t ms) {
+    if (rc > GT5X_OK && rc <= GT5X_NACK_FINGER_IS_NOT_PRESSED)
+        data.link.nack_codes[rc - GT5X_NACK_TIMEOUT]++;
+    else if (rc < GT5X_OK)
+        data.link.duplicates++;
+    
+    GT5X_OpStats * op = find(cmd);
+    if (op == NULL)
+        return;
+    
+    if (rc == GT5X_TIMEOUT) {
+        op->timeouts++;
+        return;
+    }
+    
+    if (rc == GT5X_OK)
+        op->acks++;
+    else
+        op->nacks++;
+    
+    uint16_t t = (ms < 0xFFFF) ? ms : 0xFFFF;
+    if (t < op->min_ms)
+        op->min_ms = t;
+    if (t > op->max_ms)
+        op->max_ms = t;
+    op->total_ms += t;
+    
+    uint8_t b = 0;
+    while (b < GT5X_LATENCY_BUCKETS - 1 && ms >= (2UL << (2 * b)))
+        b++;
+    op->hist[b]++;
+}
+
+void GT5X_Metrics::write_json(Print * out) {
+    GT5X_LinkStats * link = &data.link;
+    
+    out->print("{\"bytes_out\":"); out->print(link->bytes_out);
+    out->print(",\"bytes_in\":"); out->print(link->bytes_in);
+    out->print(",\"bad_checksums\":"); out->print(link->bad_checksums);
+    out->print(",\"resyncs\":"); out->print(link->resyncs);
+    out->print(",\"data_timeouts\":"); out->print(link->data_timeouts);
+    out->print(",\"sink_aborts\":"); out->print(link->sink_aborts);
+    out->print(",\"duplicates\":"); out->print(link->duplicates);
+    
+    out->print(",\"nacks\":{");
+    bool first = true;
+    for (uint8_t i = 0; i < GT5X_NACK_CODES; i++) {
+        if (link->nack_codes[i] == 0)
+            continue;
+        
+        if (!first)
+            out->print(',');
+        out->print("\"0x"); out->print(GT5X_NACK_TIMEOUT + i, HEX);
+        out->print("\":"); out->print(link->nack_codes[i]);
+        first = false;
+    }
+    
+    out->print("},\"ops\":[");
+    first = true;
+    for (uint8_t i = 0; i < GT5X_METRICS_OPS; i++) {
+        GT5X_OpStats * op = &data.ops[i];
+        if (op->calls == 0)
+            continue;
+        
+        uint16_t answered = op->acks + op->nacks;
+        
+        if (!first)
+            out->print(',');
+        out->print("{\"cmd\":"); out->print(op->cmd);
+        out->print(",\"calls\":"); out->print(op->calls);
+        out->print(",\"acks\":"); out->print(op->acks);
+        out->print(",\"nacks\":"); out->print(op->nacks);
+        out->print(",\"timeouts\":"); out->print(op->timeouts);
+        out->print(",\"min_ms\":"); out->print(answered ? op->min_ms : 0);
+        out->print(",\"avg_ms\":"); out->print(answered ? op->total_ms / answered : 0);
+        out->print(",\"max_ms\":"); out->print(op->max_ms);
+        out->print(",\"hist\":[");
+        for (uint8_t b = 0; b < GT5X_LATENCY_BUCKETS; b++) {
+            if (b != 0)
+                out->print(',');
+            out->print(op->hist[b]);
+        }
+        out->print("]}");
+        first = false;
+    }
+    
+    out->println("]}");
+}
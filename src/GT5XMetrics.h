@@ -0,0 +1,77 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_METRICS_H
+#define GT5X_METRICS_H
+
+#include "GT5X.h"
+
+/* every command in GT5X.h, in descriptor table order */
+#define GT5X_METRICS_OPS            GT5X_COMMAND_COUNT
+
+/* latency histogram, bucket i counts responses under 2 << (2 * i) ms, 
+   i.e. <2, <8, <32, <128, <512, <2048, <8192, and the rest */
+#define GT5X_LATENCY_BUCKETS        8
+
+/* GT5X_NACK_TIMEOUT ... GT5X_NACK_FINGER_IS_NOT_PRESSED */
+#define GT5X_NACK_CODES             (GT5X_NACK_FINGER_IS_NOT_PRESSED - GT5X_OK)
+
+typedef struct {
+    uint16_t cmd;
+    uint16_t calls;
+    uint16_t acks;
+    uint16_t nacks;
+    uint16_t timeouts;
+    
+    /* over answered calls, ACK or NACK, from the command going out to its final response */
+    uint16_t min_ms;
+    uint16_t max_ms;
+    uint32_t total_ms;
+    uint16_t hist[GT5X_LATENCY_BUCKETS];
+} GT5X_OpStats;
+
+typedef struct {
+    uint32_t bytes_out;         /* command and data packets, framing included */
+    uint32_t bytes_in;          /* everything read from the transport */
+    uint16_t bad_checksums;     /* responses and data packets */
+    uint16_t resyncs;           /* packets thrown away for a wrong device ID */
+    uint16_t data_timeouts;     /* data packets that never arrived in full */
+    uint16_t sink_aborts;
+    uint16_t duplicates;        /* uploads refused because the template was already enrolled */
+    uint16_t nack_codes[GT5X_NACK_CODES];   /* by code, from GT5X_NACK_TIMEOUT up */
+} GT5X_LinkStats;
+
+typedef struct {
+    GT5X_LinkStats link;
+    GT5X_OpStats ops[GT5X_METRICS_OPS];
+} GT5X_MetricsData;
+
+/* Counters for every command a GT5X sends, kept in storage of the caller's 
+ * (about 1.1KB, so mind it on smaller AVRs). Attach with attach_metrics(); 
+ * GT5X only records anything if GT5X_ENABLE_METRICS is defined in GT5X.h, 
+ * and costs nothing otherwise. */
+class GT5X_Metrics {
+    public:
+        GT5X_Metrics();
+        void reset(void);
+        
+        /* consistent copy to export, e.g. once a minute, followed by reset() */
+        void snapshot(GT5X_MetricsData * out);
+        
+        /* NULL if cmd isn't a known command */
+        const GT5X_OpStats * get_op(uint16_t cmd);
+        
+        /* one-line JSON of the link stats and every command used so far */
+        void write_json(Print * out);
+        
+    private:
+        friend class GT5X;
+        
+        GT5X_OpStats * find(uint16_t cmd);
+        void record_call(uint16_t cmd);
+        void record_result(uint16_t cmd, uint16_t rc, uint32_t ms);
+        
+        GT5X_MetricsData data;
+};
+
+#endif
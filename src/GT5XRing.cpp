@@ -0,0 +1,131 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#include <Arduino.h>
+#include "GT5XRing.h"
+
+#if defined(__AVR__)
+    #include <util/atomic.h>
+    
+    /* 16-bit loads aren't atomic on AVR, so read the other side's index with the ISR held off */
+    #define GT5X_LOAD16(x)      ({ uint16_t v; ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { v = (x); } v; })
+    #define GT5X_BARRIER()      __asm__ __volatile__("" ::: "memory")
+#else
+    #define GT5X_LOAD16(x)      (x)
+    #define GT5X_BARRIER()      __sync_synchronize()
+#endif
+
+GT5X_RingTransport::GT5X_RingTransport(uint8_t * storage, uint16_t len, Print * out) : 
+    buf(storage), size(len), tx(out), head(0), tail(0), received(0), overruns(0), high_water(0)
+{
+    
+}
+
+uint16_t GT5X_RingTransport::load_head(void) {
+    return GT5X_LOAD16(head);
+}
+
+uint16_t GT5X_RingTransport::load_tail(void) {
+    return GT5X_LOAD16(tail);
+}
+
+bool GT5X_RingTransport::push(uint8_t c) {
+    /* our own index needs no protection, only the consumer's */
+    uint16_t h = head;
+    uint16_t next = (h + 1 == size) ? 0 : h + 1;
+    uint16_t t = load_tail();
+    
+    if (next == t) {
+        overruns++;
+        return false;
+    }
+    
+    buf[h] = c;
+    
+    /* the byte has to land before the consumer can see it */
+    GT5X_BARRIER();
+    head = next;
+    received++;
+    
+    uint16_t used = (next >= t) ? next - t : size - t + next;
+    if (used > high_water)
+        high_water = used;
+    
+    return true;
+}
+
+bool GT5X_RingTransport::push(const uint8_t * data, uint16_t len) {
+    bool ok = true;
+    for (uint16_t i = 0; i < len; i++) {
+        if (!push(data[i]))
+            ok = false;
+    }
+    
+    return ok;
+}
+
+uint16_t GT5X_RingTransport::available(void) {
+    uint16_t h = load_head();
+    uint16_t t = tail;
+    return (h >= t) ? h - t : size - t + h;
+}
+
+/* up to two copies, either side of the wrap */
+uint16_t GT5X_RingTransport::read(uint8_t * out, uint16_t len) {
+    uint16_t h = load_head();
+    uint16_t t = tail;
+    uint16_t n = 0;
+    
+    GT5X_BARRIER();
+    
+    while (n < len && t != h) {
+        uint16_t end = (h > t) ? h : size;
+        uint16_t chunk = end - t;
+        if (chunk > len - n)
+            chunk = len - n;
+        
+        memcpy(out + n, buf + t, chunk);
+        n += chunk;
+        t += chunk;
+        if (t == size)
+            t = 0;
+    }
+    
+    /* done with the bytes before handing their space back */
+    GT5X_BARRIER();
+    tail = t;
+    
+    return n;
+}
+
+void GT5X_RingTransport::write(const uint8_t * data, uint16_t len) {
+    tx->write(data, len);
+}
+
+void GT5X_RingTransport::discard(void) {
+    tail = load_head();
+}
+
+void GT5X_RingTransport::get_stats(GT5X_RingStats * stats) {
+#if defined(__AVR__)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#endif
+        stats->received = received;
+        stats->overruns = overruns;
+        stats->high_water = high_water;
+#if defined(__AVR__)
+    }
+#endif
+}
+
+void GT5X_RingTransport::reset_stats(void) {
+#if defined(__AVR__)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+#endif
+        received = 0;
+        overruns = 0;
+        high_water = 0;
+#if defined(__AVR__)
+    }
+#endif
+}
@@ -0,0 +1,60 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+ 
+#ifndef GT5X_RING_H
+#define GT5X_RING_H
+
+#include "GT5X.h"
+
+/* default RX buffer: enough for a whole template, or several ms of image at 115200 */
+#ifndef GT5X_RING_SIZE
+#define GT5X_RING_SIZE          512
+#endif
+
+typedef struct {
+    uint32_t received;          /* bytes pushed into the ring */
+    uint32_t overruns;          /* bytes dropped because the ring was full */
+    uint16_t high_water;        /* most bytes ever waiting at once */
+} GT5X_RingStats;
+
+/* Transport with a single-producer/single-consumer RX ring in front of GT5X. 
+ * The producer is your UART RX interrupt (push() a byte at a time) or a DMA 
+ * completion callback (push() a block); GT5X is the consumer and drains the ring 
+ * in batches. Neither side ever blocks or locks the other. Writes go straight 
+ * out through the given Print, e.g. the HardwareSerial whose RX you've hooked. */
+class GT5X_RingTransport : public GT5X_Transport {
+    public:
+        /* storage holds size bytes, one of which always stays free */
+        GT5X_RingTransport(uint8_t * storage, uint16_t size, Print * tx);
+        
+        /* producer side, safe to call from an ISR; false if anything was dropped */
+        bool push(uint8_t c);
+        bool push(const uint8_t * data, uint16_t len);
+        
+        /* consumer side */
+        uint16_t available(void);
+        uint16_t read(uint8_t * buf, uint16_t len);
+        void write(const uint8_t * data, uint16_t len);
+        void discard(void);
+        
+        void get_stats(GT5X_RingStats * stats);
+        void reset_stats(void);
+        
+    private:
+        uint16_t load_head(void);
+        uint16_t load_tail(void);
+        
+        uint8_t * buf;
+        uint16_t size;
+        Print * tx;
+        
+        /* head is only written by the producer, tail only by the consumer */
+        volatile uint16_t head;
+        volatile uint16_t tail;
+        
+        volatile uint32_t received;
+        volatile uint32_t overruns;
+        volatile uint16_t high_water;
+};
+
+#endif
@@ -0,0 +1,341 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <Arduino.h>
+#include "GT5XShards.h"
+#include "GT5XCache.h"
+
+static const uint8_t shards_magic[] = {'G', 'T', '5', 'S'};
+
+GT5X_Shards::GT5X_Shards(GT5X_Manager * manager, GT5X_ShardEntry * table, uint16_t nids, uint16_t slots_per_sensor) :
+    mgr(manager), map(table), max_ids(nids), slots(slots_per_sensor), outstanding(0), reported(true),
+    result_rc(GT5X_OK), result_gid(GT5X_NO_GID), query(NULL), cb(NULL), cb_ctx(NULL)
+{
+    clear();
+}
+
+void GT5X_Shards::clear(void) {
+    for (uint16_t i = 0; i < max_ids; i++) {
+        map[i].sensor = GT5X_NO_SENSOR;
+        map[i].slot = 0;
+    }
+}
+
+bool GT5X_Shards::lookup(uint16_t gid, uint8_t * sensor, uint16_t * slot) {
+    if (gid >= max_ids || map[gid].sensor == GT5X_NO_SENSOR)
+        return false;
+
+    *sensor = map[gid].sensor;
+    *slot = map[gid].slot;
+    return true;
+}
+
+/* reverse lookup, only needed once per hit */
+uint16_t GT5X_Shards::find(uint8_t sensor, uint16_t slot) {
+    for (uint16_t i = 0; i < max_ids; i++) {
+        if (map[i].sensor == sensor && map[i].slot == slot)
+            return i;
+    }
+
+    return GT5X_NO_GID;
+}
+
+uint16_t GT5X_Shards::count(uint8_t sensor) {
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < max_ids; i++) {
+        if (map[i].sensor == sensor)
+            n++;
+    }
+
+    return n;
+}
+
+bool GT5X_Shards::assign(uint16_t gid, uint8_t sensor, uint16_t slot) {
+    if (gid >= max_ids || sensor >= mgr->count() || slot >= slots)
+        return false;
+
+    map[gid].sensor = sensor;
+    map[gid].slot = slot;
+    return true;
+}
+
+/* Runs the manager until it has nothing queued or in flight on the sensor, 
+   so a blocking command doesn't cut in on one of its own */
+GT5X * GT5X_Shards::claim(uint8_t sensor) {
+    GT5X * finger = mgr->sensor(sensor);
+
+    while (mgr->queue_depth(sensor) != 0 || finger->is_busy()) {
+        mgr->poll();
+
+        /* anything started on it outside the queue */
+        finger->poll();
+        mgr->idle();
+    }
+
+    return finger;
+}
+
+/* lowest slot on the sensor that's neither mapped nor enrolled;
+   the sensor's cache answers this without a round-trip if it has one */
+uint16_t GT5X_Shards::free_slot(uint8_t sensor) {
+    GT5X * finger = mgr->sensor(sensor);
+    GT5X_Cache * cache = finger->get_cache();
+
+    if (cache != NULL && cache->is_valid()) {
+        uint16_t slot = cache->find_free(0);
+        return (slot == GT5X_NO_FREE_ID || slot >= slots) ? GT5X_NO_GID : slot;
+    }
+
+    /* nothing above the highest mapped slot can be in the map, so start there */
+    uint16_t next = 0;
+    for (uint16_t i = 0; i < max_ids; i++) {
+        if (map[i].sensor == sensor && map[i].slot >= next)
+            next = map[i].slot + 1;
+    }
+
+    for (uint16_t slot = next; slot < slots; slot++) {
+        uint16_t rc = finger->is_enrolled(slot);
+        if (rc == GT5X_NACK_IS_NOT_USED)
+            return slot;
+        else if (rc != GT5X_OK)
+            return GT5X_NO_GID;
+    }
+
+    /* full up top, look for holes left by remove() */
+    for (uint16_t slot = 0; slot < next; slot++) {
+        if (find(sensor, slot) == GT5X_NO_GID && finger->is_enrolled(slot) == GT5X_NACK_IS_NOT_USED)
+            return slot;
+    }
+
+    return GT5X_NO_GID;
+}
+
+uint16_t GT5X_Shards::add_template(uint16_t gid, const uint8_t * tmpl) {
+    if (gid >= max_ids)
+        return GT5X_NACK_INVALID_POS;
+    if (map[gid].sensor != GT5X_NO_SENSOR)
+        return GT5X_NACK_IS_ALREADY_USED;
+    if (is_busy())
+        return GT5X_BUSY;
+
+    uint16_t counts[GT5X_MAX_SENSORS];
+    memset(counts, 0, sizeof(counts));
+    for (uint16_t i = 0; i < max_ids; i++) {
+        if (map[i].sensor < GT5X_MAX_SENSORS)
+            counts[map[i].sensor]++;
+    }
+
+    /* least loaded first, so the shards fill evenly */
+    bool tried[GT5X_MAX_SENSORS];
+    memset(tried, 0, sizeof(tried));
+
+    for (uint8_t n = 0; n < mgr->count(); n++) {
+        uint8_t sensor = GT5X_NO_SENSOR;
+        for (uint8_t i = 0; i < mgr->count(); i++) {
+            if (!tried[i] && (sensor == GT5X_NO_SENSOR || counts[i] < counts[sensor]))
+                sensor = i;
+        }
+        tried[sensor] = true;
+
+        GT5X * finger = claim(sensor);
+        uint16_t slot = free_slot(sensor);
+        if (slot == GT5X_NO_GID)
+            continue;
+
+        /* duplicates are only visible to the module they're on, so don't bother asking */
+        uint16_t rc = finger->set_template(slot, false);
+        if (rc == GT5X_OK)
+            rc = finger->write_raw((uint8_t *)tmpl, GT5X_TEMPLATESZ, true);
+        if (rc != GT5X_OK)
+            return rc;
+
+        assign(gid, sensor, slot);
+        return GT5X_OK;
+    }
+
+    return GT5X_NACK_DB_IS_FULL;
+}
+
+uint16_t GT5X_Shards::remove(uint16_t gid) {
+    uint8_t sensor;
+    uint16_t slot;
+
+    if (!lookup(gid, &sensor, &slot))
+        return GT5X_NACK_IS_NOT_USED;
+    if (is_busy())
+        return GT5X_BUSY;
+
+    uint16_t rc = claim(sensor)->delete_id(slot);
+    if (rc != GT5X_OK && rc != GT5X_NACK_IS_NOT_USED)
+        return rc;
+
+    map[gid].sensor = GT5X_NO_SENSOR;
+    return GT5X_OK;
+}
+
+bool GT5X_Shards::start_identify(const uint8_t * tmpl, GT5X_Callback callback, void * ctx) {
+    uint8_t n = mgr->count();
+    if (n == 0 || is_busy())
+        return false;
+
+    /* all or nothing: a shard left out could hold the match */
+    for (uint8_t i = 0; i < n; i++) {
+        if (mgr->queue_depth(i) > GT5X_QUEUE_DEPTH)
+            return false;
+    }
+
+    cb = callback;
+    cb_ctx = ctx;
+    reported = false;
+    result_rc = GT5X_NACK_IDENTIFY_FAILED;
+    result_gid = GT5X_NO_GID;
+    query = tmpl;
+
+    /* a sensor busy with something else takes the query once it's done */
+    for (uint8_t i = 0; i < n; i++) {
+        mgr->submit(i, GT5X_IDENTIFYTEMPLATE1_N, 0, on_ack, this);
+        outstanding++;
+    }
+
+    return true;
+}
+
+/* the module takes the template once it has ACKed the command */
+void GT5X_Shards::on_ack(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    GT5X_Shards * self = (GT5X_Shards *)ctx;
+
+    if (rc != GT5X_OK)
+        on_result(sensor, rc, param, ctx);
+    else if (!sensor->start_data(self->query, GT5X_TEMPLATESZ, on_result, self))
+        on_result(sensor, GT5X_BUSY, 0, ctx);
+}
+
+void GT5X_Shards::on_result(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    GT5X_Shards * self = (GT5X_Shards *)ctx;
+    self->outstanding--;
+
+    if (self->reported)
+        return;
+
+    uint8_t idx = 0;
+    while (idx < self->mgr->count() && self->mgr->sensor(idx) != sensor)
+        idx++;
+
+    if (rc == GT5X_OK) {
+        /* a template nobody mapped isn't part of the gallery */
+        uint16_t gid = self->find(idx, param);
+        if (gid != GT5X_NO_GID) {
+            self->result_rc = GT5X_OK;
+            self->result_gid = gid;
+        }
+    }
+    /* a shard that couldn't answer may have held the match, so that beats a plain miss */
+    else if (rc != GT5X_NACK_IDENTIFY_FAILED && rc != GT5X_NACK_DB_IS_EMPTY) {
+        self->result_rc = rc;
+    }
+
+    /* first hit wins; the others are still drained by poll() */
+    if (self->result_gid != GT5X_NO_GID || self->outstanding == 0) {
+        self->reported = true;
+        if (self->cb != NULL)
+            self->cb(self->result_gid != GT5X_NO_GID ? sensor : NULL,
+                     self->result_gid != GT5X_NO_GID ? GT5X_OK : self->result_rc,
+                     self->result_gid, self->cb_ctx);
+    }
+}
+
+/* Returns true while any shard is still busy with the current query,
+   which may be after the result has been reported. Drives the whole manager */
+bool GT5X_Shards::poll(void) {
+    if (outstanding != 0)
+        mgr->poll();
+
+    return is_busy();
+}
+
+uint16_t GT5X_Shards::identify(const uint8_t * tmpl, uint16_t * gid) {
+    /* whatever's left of the last query */
+    while (poll()) {
+        mgr->idle();
+    }
+
+    if (!start_identify(tmpl))
+        return GT5X_BUSY;
+
+    while (!reported) {
+        poll();
+        mgr->idle();
+    }
+
+    if (result_gid == GT5X_NO_GID)
+        return result_rc;
+
+    *gid = result_gid;
+    return GT5X_OK;
+}
+
+uint16_t GT5X_Shards::save(GT5X_Sink * out) {
+    uint8_t header[8] = {shards_magic[0], shards_magic[1], shards_magic[2], shards_magic[3],
+                         GT5X_SHARDS_VERSION, mgr->count(), (uint8_t)max_ids, (uint8_t)(max_ids >> 8)};
+    if (!out->write(header, sizeof(header)))
+        return GT5X_ABORTED;
+
+    uint16_t sum = 0;
+    for (uint16_t i = 0; i < max_ids; i++) {
+        uint8_t entry[3] = {map[i].sensor, (uint8_t)map[i].slot, (uint8_t)(map[i].slot >> 8)};
+        sum += entry[0] + entry[1] + entry[2];
+
+        if (!out->write(entry, sizeof(entry)))
+            return GT5X_ABORTED;
+    }
+
+    uint8_t trailer[2] = {(uint8_t)sum, (uint8_t)(sum >> 8)};
+    if (!out->write(trailer, sizeof(trailer)))
+        return GT5X_ABORTED;
+
+    return GT5X_OK;
+}
+
+/* There's nowhere to stage a second copy of the map, so on a short read, 
+   an entry out of range or a bad checksum it's left cleared rather than half-loaded */
+uint16_t GT5X_Shards::load(GT5X_Source * in) {
+    uint8_t header[8];
+    if (!in->read_fully(header, sizeof(header)))
+        return GT5X_TIMEOUT;
+
+    uint16_t entries = header[6] | (header[7] << 8);
+    if (memcmp(header, shards_magic, sizeof(shards_magic)) != 0 || header[4] != GT5X_SHARDS_VERSION
+        || header[5] > mgr->count() || entries > max_ids)
+        return GT5X_BAD_FORMAT;
+
+    clear();
+
+    uint16_t sum = 0;
+    for (uint16_t i = 0; i < entries; i++) {
+        uint8_t entry[3];
+        if (!in->read_fully(entry, sizeof(entry))) {
+            clear();
+            return GT5X_TIMEOUT;
+        }
+
+        sum += entry[0] + entry[1] + entry[2];
+        uint16_t slot = entry[1] | (entry[2] << 8);
+
+        /* a map from another setup would send queries to sensors or slots that aren't there */
+        if (entry[0] != GT5X_NO_SENSOR && (entry[0] >= mgr->count() || slot >= slots)) {
+            clear();
+            return GT5X_BAD_FORMAT;
+        }
+
+        map[i].sensor = entry[0];
+        map[i].slot = slot;
+    }
+
+    uint8_t trailer[2];
+    if (!in->read_fully(trailer, sizeof(trailer)) || (trailer[0] | (trailer[1] << 8)) != sum) {
+        clear();
+        return GT5X_BAD_CHECKSUM;
+    }
+
+    return GT5X_OK;
+}
@@ -0,0 +1,83 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#ifndef GT5X_SHARDS_H
+#define GT5X_SHARDS_H
+
+#include "GT5X.h"
+#include "GT5XManager.h"
+
+/* where one global ID lives */
+typedef struct {
+    uint8_t sensor;             /* manager index, GT5X_NO_SENSOR if unassigned */
+    uint16_t slot;              /* ID on that sensor */
+} GT5X_ShardEntry;
+
+/* returned when a global ID can't be found or placed */
+#define GT5X_NO_GID             0xFFFF
+
+/* Map file, all fields little-endian:
+ *
+ *  header:   'G' 'T' '5' 'S', version (1), number of sensors (1), entries (2)
+ *  entries:  sensor (1), slot (2), one per global ID
+ *  trailer:  16-bit sum of the entry bytes (2) */
+#define GT5X_SHARDS_VERSION     1
+
+/* Spreads a gallery too big for one module across every sensor of a GT5X_Manager.
+ * Global IDs are mapped to (sensor, slot) pairs in a caller-provided table that
+ * can be saved and loaded with any sink/source. A 1:N query queues IdentifyTemplate1_N
+ * with the template on every sensor through the manager and the first hit wins, so
+ * latency stays at about one identify however many sensors there are. */
+class GT5X_Shards {
+    public:
+        /* map holds max_ids entries; slots_per_sensor is the module capacity, e.g. 3000 */
+        GT5X_Shards(GT5X_Manager * mgr, GT5X_ShardEntry * map, uint16_t max_ids, uint16_t slots_per_sensor);
+        void clear(void);
+
+        bool lookup(uint16_t gid, uint8_t * sensor, uint16_t * slot);
+        uint16_t find(uint8_t sensor, uint16_t slot);
+        uint16_t count(uint8_t sensor);
+
+        /* record a placement made some other way, e.g. templates enrolled before sharding */
+        bool assign(uint16_t gid, uint8_t sensor, uint16_t slot);
+
+        /* upload a template to the least loaded sensor and map it to gid. Both block, 
+           and wait for the manager to finish what it has queued on the sensor first */
+        uint16_t add_template(uint16_t gid, const uint8_t * tmpl);
+        uint16_t remove(uint16_t gid);
+
+        /* non-blocking fan-out; cb gets the global ID as its param and the sensor
+           that matched (NULL on a miss). tmpl must stay valid until poll() returns false,
+           and poll() stands in for the manager's until then */
+        bool start_identify(const uint8_t * tmpl, GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool poll(void);
+        bool is_busy(void) { return outstanding != 0; }
+
+        /* blocks until the first hit or until every shard has missed */
+        uint16_t identify(const uint8_t * tmpl, uint16_t * gid);
+
+        uint16_t save(GT5X_Sink * out);
+        uint16_t load(GT5X_Source * in);
+
+    private:
+        static void on_ack(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        static void on_result(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        GT5X * claim(uint8_t sensor);
+        uint16_t free_slot(uint8_t sensor);
+
+        GT5X_Manager * mgr;
+        GT5X_ShardEntry * map;
+        uint16_t max_ids;
+        uint16_t slots;
+
+        /* current query */
+        uint8_t outstanding;
+        bool reported;
+        uint16_t result_rc;
+        uint16_t result_gid;
+        const uint8_t * query;
+        GT5X_Callback cb;
+        void * cb_ctx;
+};
+
+#endif
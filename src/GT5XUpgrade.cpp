@@ -0,0 +1,224 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#include <Arduino.h>
+#include "GT5XUpgrade.h"
+
+GT5X_Upgrader::GT5X_Upgrader(GT5X * sensor, uint8_t * work, uint16_t size) :
+    finger(sensor), in(NULL), cmd(0), cb(NULL), cb_ctx(NULL), work_size(size), cur(0), read_pos(0),
+    source_ok(true), stage(GT5X_UPGRADE_IDLE), attempts(0), resumable(false), result(GT5X_OK),
+    run_start(0), banked_ms(0)
+{
+    bufs[0] = work;
+    bufs[1] = (size >= 2 * GT5X_UPGRADE_CHUNKSZ) ? work + GT5X_UPGRADE_CHUNKSZ : NULL;
+    lens[0] = lens[1] = 0;
+    memset(&progress, 0, sizeof(progress));
+}
+
+bool GT5X_Upgrader::start(uint16_t command, GT5X_Source * source, uint32_t size, GT5X_Callback callback, void * ctx) {
+    if (command != GT5X_UPGRADEFIRMWARE && command != GT5X_UPGRADEISOCDIMAGE)
+        return false;
+    if (is_busy() || size == 0 || work_size < GT5X_UPGRADE_CHUNKSZ)
+        return false;
+
+    if (!finger->start_command(command, size, on_step, this))
+        return false;
+
+    in = source;
+    cmd = command;
+    cb = callback;
+    cb_ctx = ctx;
+
+    cur = 0;
+    lens[0] = lens[1] = 0;
+    read_pos = 0;
+    source_ok = true;
+    attempts = 0;
+    resumable = false;
+
+    memset(&progress, 0, sizeof(progress));
+    progress.total = size;
+    banked_ms = 0;
+    run_start = millis();
+
+    stage = GT5X_UPGRADE_OPEN;
+    return true;
+}
+
+/* Sends the chunk that failed again and carries on from there */
+bool GT5X_Upgrader::resume(GT5X_Callback callback, void * ctx) {
+    if (is_busy() || !resumable || finger->is_busy())
+        return false;
+
+    cb = callback;
+    cb_ctx = ctx;
+    attempts = 0;
+    resumable = false;
+    run_start = millis();
+
+    send_chunk();
+    return true;
+}
+
+uint16_t GT5X_Upgrader::upgrade(uint16_t command, GT5X_Source * source, uint32_t size) {
+    if (!start(command, source, size))
+        return GT5X_BUSY;
+
+    return wait();
+}
+
+uint16_t GT5X_Upgrader::wait(void) {
+    while (poll()) {
+        finger->idle();
+    }
+
+    return result;
+}
+
+/* Returns true while the upload is still going */
+bool GT5X_Upgrader::poll(void) {
+    if (!is_busy())
+        return false;
+
+    /* the callback may have just sent a chunk, so read ahead
+       before the caller waits on its ACK */
+    finger->poll();
+    if (is_busy())
+        prefetch();
+    return is_busy();
+}
+
+void GT5X_Upgrader::on_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx) {
+    (void)sensor;
+    ((GT5X_Upgrader *)ctx)->advance(rc, param);
+}
+
+void GT5X_Upgrader::advance(uint16_t rc, uint32_t param) {
+    update_elapsed();
+
+    if (stage == GT5X_UPGRADE_OPEN) {
+        if (rc != GT5X_OK)
+            finish(rc, false);
+        else
+            send_chunk();
+        return;
+    }
+
+    if (rc == GT5X_OK) {
+        /* a module that ACKs with its running count gives away a chunk it took twice,
+           i.e. one sent again after its ACK rather than the chunk itself was lost */
+        if (param != 0 && param != progress.sent + lens[cur]) {
+            finish(GT5X_BAD_FORMAT, false);
+            return;
+        }
+
+        progress.sent += lens[cur];
+        progress.chunks++;
+        lens[cur] = 0;
+        attempts = 0;
+
+        if (progress.sent == progress.total) {
+            finish(GT5X_OK, false);
+            return;
+        }
+
+        /* the other buffer holds the next chunk if it could be read ahead */
+        if (bufs[1] != NULL)
+            cur ^= 1;
+        send_chunk();
+        return;
+    }
+
+    /* the module NACKs a chunk that arrived damaged; a timeout or a damaged
+       response is taken to mean the same and checked against the next ACK */
+    if (attempts < GT5X_UPGRADE_RETRIES) {
+        attempts++;
+        progress.retries++;
+        send_chunk();
+        return;
+    }
+
+    finish(rc, true);
+}
+
+/* while the module is busy with one chunk, read the next into the other buffer.
+   Before the first chunk is out that's the first buffer */
+void GT5X_Upgrader::prefetch(void) {
+    uint8_t idx = (lens[cur] == 0) ? cur : cur ^ 1;
+    if (bufs[idx] == NULL || lens[idx] != 0 || !source_ok || read_pos == progress.total)
+        return;
+
+    load(idx);
+}
+
+bool GT5X_Upgrader::load(uint8_t idx) {
+    uint32_t left = progress.total - read_pos;
+    uint16_t len = (left < GT5X_UPGRADE_CHUNKSZ) ? left : GT5X_UPGRADE_CHUNKSZ;
+
+    /* a partial read has already used up some of the source, so there's no retrying it */
+    if (!in->read_fully(bufs[idx], len)) {
+        source_ok = false;
+        return false;
+    }
+
+    lens[idx] = len;
+    read_pos += len;
+    return true;
+}
+
+void GT5X_Upgrader::send_chunk(void) {
+    if (lens[cur] == 0) {
+        /* nothing read ahead, so the link waits on the source */
+        uint32_t t0 = millis();
+        bool ok = source_ok && load(cur);
+        progress.stall_ms += millis() - t0;
+
+        if (!ok) {
+            finish(GT5X_ABORTED, false);
+            return;
+        }
+    }
+
+    stage = GT5X_UPGRADE_CHUNK;
+    if (!finger->start_data(bufs[cur], lens[cur], on_step, this))
+        finish(GT5X_BUSY, true);
+}
+
+void GT5X_Upgrader::finish(uint16_t rc, bool can_resume) {
+    update_elapsed();
+    banked_ms = progress.elapsed_ms;
+
+    stage = GT5X_UPGRADE_IDLE;
+    resumable = can_resume;
+    result = rc;
+
+    if (cb != NULL)
+        cb(finger, rc, progress.sent, cb_ctx);
+}
+
+void GT5X_Upgrader::update_elapsed(void) {
+    progress.elapsed_ms = banked_ms + (millis() - run_start);
+}
+
+uint32_t GT5X_Upgrader::bytes_per_sec(void) {
+    uint32_t ms = progress.elapsed_ms;
+    if (ms == 0 || progress.sent == 0)
+        return 0;
+
+    /* x1000 first would overflow past about 4 MB */
+    if (progress.sent < 4000000UL)
+        return progress.sent * 1000 / ms;
+    return progress.sent / ms * 1000;
+}
+
+/* what's left at the rate so far */
+uint32_t GT5X_Upgrader::eta_ms(void) {
+    uint32_t rate = bytes_per_sec();
+    if (rate == 0)
+        return 0;
+
+    uint32_t left = progress.total - progress.sent;
+    if (left < 4000000UL)
+        return left * 1000 / rate;
+    return left / rate * 1000;
+}
@@ -0,0 +1,98 @@
+/* Written by Brian Ejike (2018) brianrho94@gmail.com
+ * Distributed under the terms of the MIT license */
+
+#ifndef GT5X_UPGRADE_H
+#define GT5X_UPGRADE_H
+
+#include "GT5X.h"
+
+/* times a chunk is sent again after a NACK, bad checksum or timeout before giving up */
+#ifndef GT5X_UPGRADE_RETRIES
+#define GT5X_UPGRADE_RETRIES        3
+#endif
+
+typedef struct {
+    uint32_t total;             /* image size in bytes */
+    uint32_t sent;              /* bytes the module has ACKed */
+    uint16_t chunks;            /* chunks ACKed */
+    uint16_t retries;           /* chunks sent again */
+    uint32_t elapsed_ms;        /* time spent on the upload so far, across resume() */
+    uint32_t stall_ms;          /* part of that the link sat idle waiting on the source */
+} GT5X_UpgradeProgress;
+
+/* Non-blocking firmware or ISO CD image upload: UpgradeFirmware/UpgradeISOCDImage
+ * with the image size, then the image in GT5X_UPGRADE_CHUNKSZ data packets, each
+ * ACKed before the next goes out. Given room for two chunks, the next one is read
+ * from the source while the module is busy with the last, so a slow SD card or
+ * SPI flash costs little on top of the link itself.
+ *
+ * A chunk that fails is sent again, up to GT5X_UPGRADE_RETRIES times. After that
+ * the upload stops with the chunk still in the work buffer, and resume() carries on
+ * from it once the link is back, as long as nothing else has been sent to the module
+ * in between. A source that runs dry stops it for good with GT5X_ABORTED, and so
+ * does GT5X_BAD_FORMAT if the byte count in an ACK says the module took a chunk
+ * twice; the upload has to be started over in both cases.
+ *
+ * cb is called once when the upload stops, with GT5X_OK, a NACK code, GT5X_TIMEOUT,
+ * GT5X_BAD_CHECKSUM, GT5X_ABORTED or GT5X_BAD_FORMAT; param is the number of bytes ACKed. */
+class GT5X_Upgrader {
+    public:
+        /* work holds one chunk, or two to read ahead */
+        GT5X_Upgrader(GT5X * sensor, uint8_t * work, uint16_t work_size);
+
+        /* cmd is GT5X_UPGRADEFIRMWARE or GT5X_UPGRADEISOCDIMAGE; in must supply size bytes */
+        bool start(uint16_t cmd, GT5X_Source * in, uint32_t size, GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool resume(GT5X_Callback cb = NULL, void * ctx = NULL);
+        bool can_resume(void) { return resumable; }
+        bool poll(void);
+        bool is_busy(void) { return stage != GT5X_UPGRADE_IDLE; }
+
+        /* blocking: the whole upload, or the rest of one after start()/resume() */
+        uint16_t upgrade(uint16_t cmd, GT5X_Source * in, uint32_t size);
+        uint16_t wait(void);
+
+        /* over the time spent so far, 0 until the first chunk is in */
+        uint32_t bytes_per_sec(void);
+        uint32_t eta_ms(void);
+
+        GT5X_UpgradeProgress progress;
+
+    private:
+        enum {
+            GT5X_UPGRADE_IDLE,
+            GT5X_UPGRADE_OPEN,
+            GT5X_UPGRADE_CHUNK
+        };
+
+        static void on_step(GT5X * sensor, uint16_t rc, uint32_t param, void * ctx);
+        void advance(uint16_t rc, uint32_t param);
+        void prefetch(void);
+        bool load(uint8_t idx);
+        void send_chunk(void);
+        void finish(uint16_t rc, bool can_resume);
+        void update_elapsed(void);
+
+        GT5X * finger;
+        GT5X_Source * in;
+        uint16_t cmd;
+        GT5X_Callback cb;
+        void * cb_ctx;
+
+        /* bufs[1] is NULL without room to read ahead; len 0 means empty */
+        uint8_t * bufs[2];
+        uint16_t lens[2];
+        uint16_t work_size;
+        uint8_t cur;
+        uint32_t read_pos;
+        bool source_ok;
+
+        uint8_t stage;
+        uint8_t attempts;
+        bool resumable;
+        uint16_t result;
+
+        uint32_t run_start;
+        uint32_t banked_ms;
+};
+
+#endif